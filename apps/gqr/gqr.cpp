@@ -15,12 +15,13 @@ using namespace husky::losha;
 
 typedef int ItemIdType;
 typedef float ItemElementType;
-typedef ItemIdType QueryMsg;
+typedef BoundedQueryMsg<ItemIdType> QueryMsg;
 typedef std::pair<ItemIdType, ItemElementType> AnswerMsg;
-typedef GQRQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Query;
-typedef GQRItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Item;
-typedef LSHBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Bucket;
-PCAFactory<ItemIdType, ItemElementType> factory;
+typedef PCAFactory<ItemIdType, ItemElementType> Factory;
+typedef GQRQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Query;
+typedef GQRItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Item;
+typedef LSHBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Bucket;
+Factory factory;
 std::once_flag factory_flag;
 
 void lsh() {
@@ -29,14 +30,36 @@ void lsh() {
     std::string modelFilePath = husky::Context::get_param("modelFile");
     std::call_once(factory_flag, [&modelFilePath]() {
         factory.initialize(modelFilePath);
+        configureAttributes(factory);
     });
 
     int BytesPerVector = factory.getDimension() * 4 + 8;
     std::string itemPath = husky::Context::get_param("itemPath");
     std::string queryPath = husky::Context::get_param("queryPath");
     int numIteration = std::stoi(husky::Context::get_param("maxIteration"));
-    auto& binaryInputFormat = husky::io::InputFormatStore::create_chunk_inputformat(BytesPerVector); 
-    loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdFvecs, binaryInputFormat, itemPath, queryPath, numIteration);
+
+    // optional probing knobs, see GQRConfig
+    GQRConfig& config = GLOBAL_GQRConfig;
+    if (husky::Context::get_param("topK") != "")
+        config.topK = std::stoi(husky::Context::get_param("topK"));
+    if (husky::Context::get_param("answerBudget") != "")
+        config.answerBudget = std::stoul(husky::Context::get_param("answerBudget"));
+    if (husky::Context::get_param("bucketsPerRound") != "")
+        config.bucketsPerRound = std::stoi(husky::Context::get_param("bucketsPerRound"));
+    // a larger boundScale stops earlier at the risk of missing neighbours
+    config.boundScale = husky::Context::get_param("boundScale") != ""
+        ? std::stof(husky::Context::get_param("boundScale"))
+        : 1.0 / std::sqrt(factory.getRow());
+    // the answers to the last probes arrive one round later
+    config.maxRounds = numIteration > 1 ? numIteration - 1 : 0;
+    // file:// paths are mmap'ed locally instead of read from HDFS
+    if (MmapInputFormat::isLocalPath(itemPath)) {
+        MmapInputFormat mmapInputFormat(BytesPerVector);
+        loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdFvecs, mmapInputFormat, itemPath, queryPath, numIteration);
+    } else {
+        auto& binaryInputFormat = husky::io::InputFormatStore::create_chunk_inputformat(BytesPerVector);
+        loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdFvecs, binaryInputFormat, itemPath, queryPath, numIteration);
+    }
 }
 
 int main(int argc, char ** argv) {
@@ -3,8 +3,11 @@
 #include <string>
 #include <utility>
 #include <vector>
+#include <algorithm>
 #include <cmath>
+#include <limits>
 #include <mutex>
+#include <unordered_set>
 #include "core/engine.hpp"
 #include "io/hdfs_manager.hpp"
 
@@ -16,56 +19,89 @@
 #include "lshcore/lshquery.hpp"
 #include "lshcore/lshitem.hpp"
 using namespace husky::losha;
-using lshbox::TopK;
-using lshbox::IdAndDstPair;
 
 Tree* GLOBAL_Tree = NULL;
 std::once_flag fvs_flag;
 
+// probing knobs, filled from the conf by lsh()
+struct GQRConfig {
+    // neighbours reported per query
+    size_t topK = 20;
+    // distinct answers a query may receive before it stops, 0 for no limit.
+    // Items only answer with candidates that beat the k-th distance once the
+    // top-k is full, so the candidates they prune do not count; such a query
+    // stops by the QD bound or maxRounds instead
+    size_t answerBudget = 0;
+    // buckets probed per table and round
+    int bucketsPerRound = 1;
+    // stop once boundScale * QD of the next bucket reaches the k-th distance;
+    // QD sums |p_i| over the flipped bits, so 1 / sqrt(row) makes it a lower
+    // bound of sqrt(sum p_i^2), the default set by lsh()
+    float boundScale = 1.0;
+    // rounds after which a query reports whatever it has, maxIteration - 1
+    unsigned maxRounds = 20;
+};
+GQRConfig GLOBAL_GQRConfig;
+
+/*
+ * Probes buckets in ascending quantization distance (QD) over all tables.
+ * Each round sends up to bucketsPerRound * numTables buckets, and a query
+ * finishes on its own once its top-k is full and the next bucket's QD is
+ * past the k-th distance, once it received answerBudget answers, or once all
+ * tables are exhausted.
+ * */
 template<
     typename ItemIdType,
     typename ItemElementType,
     typename QueryMsg,
-    typename AnswerMsg>
-class GQRQuery : public LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> {
+    typename AnswerMsg,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
+class GQRQuery : public LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType> {
 public:
     unsigned iteration = 0;
-    TopK topk;
     explicit GQRQuery(
-        const typename GQRQuery::KeyT& id):LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>(id)
-        , topk(20) {}
-    void query(LSHFactory<ItemIdType, ItemElementType>& fty, const vector<AnswerMsg>& inMsg) override {
+        const typename GQRQuery::KeyT& id):LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>(id) {}
+    void query(FactoryType& fty, const vector<AnswerMsg>& inMsg) override {
 
         // initliaze fvs
         std::call_once(fvs_flag, [&fty]() {
                 GLOBAL_Tree = new Tree(fty.getRow());
         });
+        const GQRConfig& config = GLOBAL_GQRConfig;
 
         if (iteration == 0) {
             initialize(fty, GLOBAL_Tree);
-            this->queryMsg = this->getItemId();
-            for (auto& bId : fty.calItemBuckets(this->getQuery())) {
-                this->sendToBucket(bId);
-            }
+            this->queryMsg = QueryMsg(this->getItemId(), std::numeric_limits<float>::max());
+            this->sendToBuckets(fty, this->getItemVector());
         }  else {
-            topk.collect(inMsg);
-
-            if (iteration == 20) {
-                auto result = topk.getTopK();
-                for (const auto& e : result)
-                    writeHDFSTriplet(this->getItemId(), std::make_pair(e.id, e.distance), "hdfs_namenode", "hdfs_namenode_port", "outputPath");
+            numAnswers_ += collect(inMsg, config.topK);
+
+            bool converged = topk_.size() == config.topK
+                && config.boundScale * nextScore() >= topk_.front().first;
+            bool overBudget = config.answerBudget != 0 && numAnswers_ >= config.answerBudget;
+            if (converged || overBudget || exhausted() || iteration >= config.maxRounds) {
+                std::sort_heap(topk_.begin(), topk_.end());
+                for (const auto& e : topk_)
+                    writeHDFSTriplet(this->getItemId(), std::make_pair(e.second, e.first), "hdfs_namenode", "hdfs_namenode_port", "outputPath");
                 // this function will not be invoked once set finished
                 this->setFinished();
                 return;
             }
 
-            vector<int> sig(1);
-            for (int tb = 0; tb < handlers_.size(); ++tb) {
-                if (handlers_[tb].moveForward()) {
-                    unsigned long long tmp = handlers_[tb].getCurBucket();
-                    sig[0] = (int)tmp;
-                    this->sendToBucket(sig, tb);
-                }
+            // items only answer if they beat the current k-th distance
+            if (topk_.size() == config.topK) {
+                this->queryMsg.bound = topk_.front().first;
+            }
+
+            // the next buckets of all tables, smallest QD first
+            int sig;
+            for (int probe = 0; probe < config.bucketsPerRound * handlers_.size(); ++probe) {
+                int tb = nextTable();
+                if (tb == -1) break;
+                unsigned long long tmp = handlers_[tb].getCurBucket();
+                sig = (int)tmp;
+                this->sendToBucket(BucketKey(&sig, 1, tb));
+                hasNext_[tb] = handlers_[tb].moveForward();
             }
         }
         iteration++;
@@ -73,11 +109,64 @@ public:
 
 private:
     std::vector<TSTable> handlers_;
-    void initialize(const LSHFactory<ItemIdType, ItemElementType>& fty, Tree* tree) {
+    // whether handlers_[tb] is positioned on a bucket not probed yet
+    std::vector<bool> hasNext_;
+    // max-heap of (distance, item id), the k-th distance on top
+    std::vector<std::pair<float, ItemIdType>> topk_;
+    // items already collected, an item answers again from each table whose
+    // probed bucket holds it
+    std::unordered_set<ItemIdType> reported_;
+    size_t numAnswers_ = 0;
+
+    // number of items that answered for the first time
+    size_t collect(const vector<AnswerMsg>& inMsg, size_t K) {
+        size_t numNew = 0;
+        for (const auto& msg : inMsg) {
+            if (!reported_.insert(msg.first).second) continue;
+            ++numNew;
+            std::pair<float, ItemIdType> candidate(msg.second, msg.first);
+            if (topk_.size() < K) {
+                topk_.push_back(candidate);
+                std::push_heap(topk_.begin(), topk_.end());
+            } else if (candidate < topk_.front()) {
+                std::pop_heap(topk_.begin(), topk_.end());
+                topk_.back() = candidate;
+                std::push_heap(topk_.begin(), topk_.end());
+            }
+        }
+        return numNew;
+    }
+
+    // table whose next bucket has the smallest QD, -1 if all are exhausted
+    int nextTable() {
+        int best = -1;
+        float bestScore = 0;
+        for (int tb = 0; tb < handlers_.size(); ++tb) {
+            if (!hasNext_[tb]) continue;
+            float score = handlers_[tb].getCurScore();
+            if (best == -1 || score < bestScore) {
+                best = tb;
+                bestScore = score;
+            }
+        }
+        return best;
+    }
+
+    // lower bound on the QD of every bucket not probed yet
+    float nextScore() {
+        int tb = nextTable();
+        return tb == -1 ? std::numeric_limits<float>::max() : handlers_[tb].getCurScore();
+    }
+
+    bool exhausted() {
+        return nextTable() == -1;
+    }
+
+    void initialize(const FactoryType& fty, Tree* tree) {
         int numTables = fty.getBand();
         handlers_.reserve(numTables);
 
-        auto projs = fty.calProjs(this->getQuery());
+        auto projs = fty.calProjs(this->getItemVector());
         assert(projs.size() == numTables);
         for (unsigned t = 0; t < numTables; ++t) {
 
@@ -93,6 +182,11 @@ private:
 
             handlers_.emplace_back(TSTable(hashBits, projs[t], tree));
         }
+        // the query's own buckets go out with sendToBuckets, position on the next ones
+        hasNext_.resize(numTables);
+        for (unsigned t = 0; t < numTables; ++t) {
+            hasNext_[t] = handlers_[t].moveForward();
+        }
     }
 };
 
@@ -100,30 +194,22 @@ template<
     typename ItemIdType,
     typename ItemElementType, 
     typename QueryMsg, 
-    typename AnswerMsg
+    typename AnswerMsg,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>
 >
-class GQRItem : public LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> {
+class GQRItem : public LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType> {
 public:
-    explicit GQRItem(const typename GQRItem::KeyT& id):LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>(id){}
+    explicit GQRItem(const typename GQRItem::KeyT& id):LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>(id){}
 
     void answer (
-            LSHFactory<ItemIdType, ItemElementType>& factory,
+            FactoryType& factory,
             const vector<QueryMsg>& inMsgs) override {
 
-        std::unordered_set<QueryMsg> evaluated;
-        for (const auto& queryId : inMsgs)
+        size_t n = this->calQueryDistsBounded(factory, inMsgs);
+        for (size_t i = 0; i < n; ++i)
         {
-            if (evaluated.find(queryId)!= evaluated.end()) continue;
-            evaluated.insert(queryId);
-
-            const auto& queryVector = factory.getQueryVector(queryId);
-            float distance = factory.calDist(queryVector, this->getItemVector());
-            std::string result;
-            result += std::to_string(queryId) + " ";
-            result += std::to_string(this->getItemId()) + " " + std::to_string(distance) + "\n";
-
-            auto item_pair = std::make_pair(this->getItemId(), distance);
-            this->sendToQuery(queryId, item_pair);
+            auto item_pair = std::make_pair(this->getItemId(), this->batch_dists[i]);
+            this->sendToQuery(this->batch_query_ids[i], item_pair);
             // this->sendToQueryTopk(
             //     queryId, 
             //     item_pair, 
@@ -31,7 +31,7 @@ namespace losha {
 
 template<typename ItemIdType, typename ItemElementType>
 class L2HFactory:
-    public LSHFactory<ItemIdType, ItemElementType> {
+    public StaticLSHFactory<L2HFactory<ItemIdType, ItemElementType>, ItemIdType, ItemElementType> {
 public:
     L2HFunction<ItemIdType, ItemElementType> hashFunctions; 
 
@@ -96,36 +96,30 @@ public:
         return log;
     }
 
-    std::vector< std::vector<int> > calSigs (
-        const vector<ItemElementType> &itemVector) override {
+    // only one hash table, 32 bits per int, most significant bit first
+    inline int getSigLength() const {
+        return (this->_row + 31) / 32;
+    }
+
+    void calSigsInto(
+        ItemSpan<ItemElementType> itemVector, int* out) const {
 
         std::vector<bool> bits = hashFunctions.getQuantization(itemVector);
-        assert(bits.size() == this->_row); // only use one hash table
-
-        // transform bits to vector<int>
-        std::vector<int> allSignatures;
-        int bitSetIndex = 0;
-        int intValue = 0;
-        for (int i = 0; i < bits.size(); ++i) {
-            if (bitSetIndex < 32) {
+        assert(bits.size() == this->_row);
+
+        int iter = 0;
+        while (iter < bits.size()) {
+            int intValue = 0;
+            for (int i = 0; i < 32 && iter < bits.size(); ++i) {
                 intValue <<= 1;
-                intValue += 
-                bitSetIndex++;
-            } else {
-                allSignatures.push_back(intValue);
-                bitSetIndex = 0;
+                intValue += bits[iter++];
             }
+            *out++ = intValue;
         }
-        if (bitSetIndex != 0)
-            allSignatures.push_back(intValue);
-
-        std::vector< std::vector<int> > signatureInBands;
-        signatureInBands.push_back(allSignatures);
-        return signatureInBands;
     }
 
     std::vector< std::vector<float> > calProjs(
-        const std::vector<ItemElementType> &itemVector) override {
+        ItemSpan<ItemElementType> itemVector) const override {
 
         assert(this->_band == 1);
         std::vector<std::vector<float>> allProjections;
@@ -133,17 +127,12 @@ public:
         return allProjections;
     }
 
-    virtual float calDist(
-            const std::vector<ItemElementType> & queryVector,
-            const std::vector<ItemElementType> & itemVector) override {
-        typename std::vector<ItemElementType>::const_iterator qIt = queryVector.begin();
-
-        typename std::vector<ItemElementType>::const_iterator myIt = itemVector.begin();
-
+    inline float calDistImpl(
+            ItemSpan<ItemElementType> queryVector,
+            ItemSpan<ItemElementType> itemVector) const {
         float distance = 0;
-        while (myIt != itemVector.end() && qIt != queryVector.end()) {
-            distance += (*myIt - *qIt) * (*myIt - *qIt);
-            ++myIt; ++qIt;
+        for (size_t i = 0; i < queryVector.size() && i < itemVector.size(); ++i) {
+            distance += (itemVector[i] - queryVector[i]) * (itemVector[i] - queryVector[i]);
         }
         return sqrt(distance);
     }
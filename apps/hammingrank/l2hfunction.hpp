@@ -20,6 +20,7 @@
 #include <string>
 #include <vector>
 
+#include "losha/common/span.hpp"
 #include "lshcore/densevector.hpp"
 
 namespace husky {
@@ -39,8 +40,9 @@ class L2HFunction {
             this->rotation.swap(b);
         }
 
-        template<typename T>
-        inline float dotProduct(const std::vector<float> &a, const std::vector<T>& v2) {
+        // v2 is a std::vector or a Span
+        template<typename VectorType>
+        inline float dotProduct(const std::vector<float> &a, const VectorType& v2) const {
             assert(a.size() == v2.size());
             float product = 0;
             for (int i = 0; i < a.size(); ++i) {
@@ -50,7 +52,7 @@ class L2HFunction {
         }
 
         inline std::vector<float> getProjection(
-                const std::vector<ItemElementType>& itemVector) {
+                Span<const ItemElementType> itemVector) const {
             std::vector<float> pca; 
             for (int c = 0; c < transformation.size(); ++c) {
                 pca.push_back( dotProduct(transformation[c], itemVector));
@@ -63,7 +65,7 @@ class L2HFunction {
         }
 
         inline std::vector<bool> getQuantization(
-                const std::vector<ItemElementType>& itemVector) {
+                Span<const ItemElementType> itemVector) const {
             std::vector<float> projection= getProjection(itemVector);
             std::vector<bool> bits;
             for (int i = 0; i < projection.size(); ++i) {
@@ -17,10 +17,11 @@ typedef int ItemIdType;
 typedef float ItemElementType;
 typedef ItemIdType QueryMsg;
 typedef std::pair<ItemIdType, ItemElementType> AnswerMsg;
-typedef LSQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Query;
-typedef LSItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Item;
-typedef DefaultBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Bucket;
-E2LSHFactory<ItemIdType, ItemElementType> factory;
+typedef E2LSHFactory<ItemIdType, ItemElementType> Factory;
+typedef LSQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Query;
+typedef LSItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Item;
+typedef DefaultBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Bucket;
+Factory factory;
 std::once_flag factory_flag;
 
 void lsh() {
@@ -34,8 +35,14 @@ void lsh() {
     std::string itemPath = husky::Context::get_param("itemPath");
     std::string queryPath = husky::Context::get_param("queryPath");
     int numIteration = 2;
-    auto& binaryInputFormat = husky::io::InputFormatStore::create_chunk_inputformat(BytesPerVector); 
-    loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdFvecs, binaryInputFormat, itemPath, queryPath, numIteration);
+    // file:// paths are mmap'ed locally instead of read from HDFS
+    if (MmapInputFormat::isLocalPath(itemPath)) {
+        MmapInputFormat mmapInputFormat(BytesPerVector);
+        loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdFvecs, mmapInputFormat, itemPath, queryPath, numIteration);
+    } else {
+        auto& binaryInputFormat = husky::io::InputFormatStore::create_chunk_inputformat(BytesPerVector);
+        loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdFvecs, binaryInputFormat, itemPath, queryPath, numIteration);
+    }
 }
 
 int main(int argc, char ** argv) {
@@ -1,8 +1,12 @@
 #pragma once
 #include <set>
-#include <utility> 
+#include <utility>
 #include <vector>
 #include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <type_traits>
 #include <unordered_map>
 
 #include "core/engine.hpp"
@@ -15,11 +19,152 @@
 using namespace husky::losha;
 using lshbox::TopK;
 
-template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg>
-class LSQuery : public LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> {
+/*
+ * The K best items of every query in fixed-size arrays: row q is a max-heap
+ * of (distance, item id) pairs, so that an item is rejected by comparing with
+ * the root alone.
+ * */
+template<typename ItemIdType>
+class BlockedTopk {
 public:
-    explicit LSQuery(const typename LSQuery::KeyT& id):LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>(id) {}
-    void query(LSHFactory<ItemIdType, ItemElementType>& fty, const vector<AnswerMsg>& inMsgs) override {
+    typedef std::pair<float, ItemIdType> Entry;
+
+    void init(int numQueries, int K) {
+        _K = K;
+        _entries.assign(static_cast<size_t>(numQueries) * K, Entry());
+        _counts.assign(numQueries, 0);
+    }
+
+    inline bool initialized() const { return _K != 0; }
+    inline int size() const { return _counts.size(); }
+
+    // distance an item has to beat to enter row q
+    inline float worst(int q) const {
+        return _counts[q] < _K ? std::numeric_limits<float>::max() : _entries[static_cast<size_t>(q) * _K].first;
+    }
+
+    inline void offer(int q, float dist, const ItemIdType& itemId) {
+        Entry* row = &_entries[static_cast<size_t>(q) * _K];
+        int& count = _counts[q];
+        Entry entry(dist, itemId);
+        if (count < _K) {
+            row[count++] = entry;
+            std::push_heap(row, row + count);
+        } else if (entry < row[0]) {
+            std::pop_heap(row, row + _K);
+            row[_K - 1] = entry;
+            std::push_heap(row, row + _K);
+        }
+    }
+
+    void mergeInto(BlockedTopk& other) const {
+        for (int q = 0; q < size(); ++q) {
+            const Entry* row = &_entries[static_cast<size_t>(q) * _K];
+            for (int i = 0; i < _counts[q]; ++i) {
+                other.offer(q, row[i].first, row[i].second);
+            }
+        }
+    }
+
+    inline const Entry* row(int q) const { return &_entries[static_cast<size_t>(q) * _K]; }
+    inline int count(int q) const { return _counts[q]; }
+
+private:
+    int _K = 0;
+    std::vector<Entry> _entries;
+    std::vector<int> _counts;
+};
+
+/*
+ * Cache-blocked squared Euclidean scan of the items of one thread against all
+ * broadcast queries. Items are packed into a tile of kTileItems, transposed in
+ * panels of kLanes so that the innermost loop runs over the items of a panel
+ * and vectorizes; every distance still sums its dimensions in order, as
+ * calSquareE2Dist does. A tile is scanned against blocks of kQueryBlock
+ * consecutive rows of the query store.
+ * */
+template<typename ItemIdType>
+class LinearScanner {
+public:
+    static const int kLanes = 8;
+    static const int kTileItems = 64;
+    static const int kQueryBlock = 64;
+
+    template<typename QueryStoreT>
+    void add(const QueryStoreT& queries, int K, const ItemIdType& itemId, Span<const float> x) {
+        if (!_topk.initialized()) {
+            _topk.init(queries.size(), K);
+            _dimension = x.size();
+            _tile.assign(static_cast<size_t>(kTileItems) * _dimension, 0);
+            _tileIds.resize(kTileItems);
+        }
+        float* panel = &_tile[static_cast<size_t>(_numInTile / kLanes) * _dimension * kLanes];
+        int lane = _numInTile % kLanes;
+        for (int i = 0; i < _dimension; ++i) {
+            panel[i * kLanes + lane] = x[i];
+        }
+        _tileIds[_numInTile++] = itemId;
+        if (_numInTile == kTileItems) {
+            scan(queries);
+        }
+    }
+
+    template<typename QueryStoreT>
+    void scan(const QueryStoreT& queries) {
+        if (_numInTile == 0) return;
+        int numPanels = (_numInTile + kLanes - 1) / kLanes;
+        float dists[kLanes];
+        for (int qBegin = 0; qBegin < queries.size(); qBegin += kQueryBlock) {
+            int qEnd = std::min(queries.size(), qBegin + kQueryBlock);
+            for (int p = 0; p < numPanels; ++p) {
+                const float* panel = &_tile[static_cast<size_t>(p) * _dimension * kLanes];
+                int numLanes = std::min(kLanes, _numInTile - p * kLanes);
+                for (int q = qBegin; q < qEnd; ++q) {
+                    panelSquareDists(queries.getVector(q).data(), panel, dists);
+                    float worst = _topk.worst(q);
+                    const ItemIdType& queryId = queries.getId(q);
+                    for (int lane = 0; lane < numLanes; ++lane) {
+                        // exclude query with the item id
+                        const ItemIdType& itemId = _tileIds[p * kLanes + lane];
+                        if (dists[lane] < worst && itemId != queryId) {
+                            _topk.offer(q, dists[lane], itemId);
+                            worst = _topk.worst(q);
+                        }
+                    }
+                }
+            }
+        }
+        _numInTile = 0;
+    }
+
+    const BlockedTopk<ItemIdType>& getTopk() const { return _topk; }
+
+private:
+    inline void panelSquareDists(const float* q, const float* panel, float* out) const {
+        float acc[kLanes] = {0};
+        for (int i = 0; i < _dimension; ++i) {
+            const float* x = panel + i * kLanes;
+            for (int lane = 0; lane < kLanes; ++lane) {
+                float diff = q[i] - x[lane];
+                acc[lane] += diff * diff;
+            }
+        }
+        for (int lane = 0; lane < kLanes; ++lane) out[lane] = acc[lane];
+    }
+
+    BlockedTopk<ItemIdType> _topk;
+    int _dimension = 0;
+    std::vector<float> _tile;
+    std::vector<ItemIdType> _tileIds;
+    int _numInTile = 0;
+};
+
+template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
+class LSQuery : public LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType> {
+public:
+    explicit LSQuery(const typename LSQuery::KeyT& id):LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>(id) {}
+    void query(FactoryType& fty, const vector<AnswerMsg>& inMsgs) override {
         if (inMsgs.size() != 0) {
             // sort
             TopK topK(std::stoi(husky::Context::get_param("topK")));
@@ -31,38 +176,68 @@ public:
     }
 };
 
-template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg>
-class LSItem : public LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> {
+/*
+ * Items only add themselves to the LinearScanner of their thread, which scans
+ * full tiles. flushAnswers, called by the engine on every thread after the
+ * items, scans the last tile and merges the thread's top-k into the one of the
+ * process; the last thread of the process sends the merged top-k to the queries.
+ * */
+template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
+class LSItem : public LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType> {
 public:
-    explicit LSItem(const typename LSItem::KeyT& id):LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>(id){}
-    LSItem() : LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>() {}
+    static_assert(std::is_same<ItemElementType, float>::value, "the blocked linear scan is for dense float features");
+
+    explicit LSItem(const typename LSItem::KeyT& id):LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>(id){}
+    LSItem() : LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>() {}
 
     bool evaluated = false;
-    virtual void answer(LSHFactory<ItemIdType, ItemElementType>& factory, const vector<QueryMsg>& inMsgs) {
+    virtual void answer(FactoryType& factory, const vector<QueryMsg>& inMsgs) {
 
-        if (evaluated == true) 
+        if (evaluated == true)
             return;
         evaluated = true;
-        const auto & queries = factory.getAllQueries();
-        for (auto& p : queries) {
-
-            const auto& queryId = p.first;
-
-            // exclude query with the item id
-            if (queryId == this->getItemId())
-                continue;
-
-            const auto& queryVector = p.second;
-            float distance = factory.calDist(queryVector, this->getItemVector());
-
-            auto item_pair = std::make_pair(this->getItemId(), distance);
-            this->sendToQueryTopk(
-                queryId, 
-                item_pair, 
-                std::stoi(husky::Context::get_param("topK")),
-                [](const AnswerMsg& a, const AnswerMsg& b){
-                return a.second < b.second;
-            });
+        scanner().add(factory.getAllQueries(), getK(), this->getItemId(), this->getItemSpan());
+    }
+
+    static void flushAnswers(FactoryType& factory) {
+        static thread_local bool flushed = false;
+        if (flushed) return;
+        flushed = true;
+
+        const auto& queries = factory.getAllQueries();
+        LinearScanner<ItemIdType>& local = scanner();
+        local.scan(queries);
+
+        static std::mutex mergeMutex;
+        static BlockedTopk<ItemIdType> merged;
+        static int numArrived = 0;
+        std::lock_guard<std::mutex> lock(mergeMutex);
+        if (!merged.initialized()) {
+            merged.init(queries.size(), getK());
+        }
+        if (local.getTopk().initialized()) {
+            local.getTopk().mergeInto(merged);
         }
+        if (++numArrived < husky::Context::get_num_local_workers()) return;
+
+        for (int q = 0; q < merged.size(); ++q) {
+            const auto* row = merged.row(q);
+            for (int i = 0; i < merged.count(q); ++i) {
+                LSItem::item_msg_buffer.emplace_back(queries.getId(q),
+                    AnswerMsg(row[i].second, std::sqrt(row[i].first)));
+            }
+        }
+    }
+
+private:
+    static LinearScanner<ItemIdType>& scanner() {
+        static thread_local LinearScanner<ItemIdType> localScanner;
+        return localScanner;
+    }
+
+    static int getK() {
+        static const int K = std::stoi(husky::Context::get_param("topK"));
+        return K;
     }
 };
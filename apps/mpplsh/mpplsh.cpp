@@ -17,12 +17,13 @@ using namespace husky::losha;
 typedef int ItemIdType;
 typedef std::pair<int, float> ItemElementType;
 typedef ItemIdType QueryMsg;
-typedef DenseVector<ItemIdType, ItemElementType> AnswerMsg;
-typedef MPPLSHQuery<ItemIdType, ItemElementType> Query;
-typedef MPPLSHItem<ItemIdType, ItemElementType> Item;
-typedef DefaultBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Bucket;
+typedef MPPLSHHit<ItemIdType> AnswerMsg;
+typedef APSparseSimHashFactory<int, float> Factory;
+typedef MPPLSHQuery<ItemIdType, ItemElementType, Factory> Query;
+typedef MPPLSHItem<ItemIdType, ItemElementType, Factory> Item;
+typedef DefaultBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Bucket;
 
-APSparseSimHashFactory<int, float> factory;
+Factory factory;
 std::once_flag factory_flag;
 
 void lsh() {
@@ -33,13 +34,21 @@ void lsh() {
     int dimension = std::stoi(husky::Context::get_param("dimension"));
     std::call_once(factory_flag, [&]() {
         factory.initialize(band, row, dimension);
+        configureRadiusMode(factory, 0.9);
+        configureAttributes(factory);
     });
 
     std::string itemPath = husky::Context::get_param("itemPath");
     std::string queryPath = husky::Context::get_param("queryPath");
     int numIteration = std::stoi(husky::Context::get_param("maxIteration"));
-    auto& lineInputFormat = husky::io::InputFormatStore::create_line_inputformat();
-    loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdLibsvm, lineInputFormat, itemPath, queryPath, numIteration);
+    // items and queries are either both idsvecs or both idlibsvm
+    if (isIdSvecsPath(itemPath)) {
+        auto& binaryInputFormat = husky::io::InputFormatStore::create_chunk_inputformat(kIdSvecsBlockBytes);
+        loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdSvecs, binaryInputFormat, itemPath, queryPath, numIteration);
+    } else {
+        auto& lineInputFormat = husky::io::InputFormatStore::create_line_inputformat();
+        loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdLibsvm, lineInputFormat, itemPath, queryPath, numIteration);
+    }
 }
 
 int main(int argc, char ** argv) {
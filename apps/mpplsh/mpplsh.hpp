@@ -1,12 +1,14 @@
 #pragma once
-#include <set>
 #include <string>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 #include "core/engine.hpp"
 #include "io/hdfs_manager.hpp"
 
+#include "losha/common/sparsekernel.hpp"
 #include "losha/common/writer.hpp"
+#include "lshcore/bucketkey.hpp"
 #include "lshcore/lshquery.hpp"
 #include "lshcore/lshitem.hpp"
 #include "lshcore/densevector.hpp"
@@ -14,38 +16,62 @@ using namespace husky::losha;
 using std::vector;
 using std::pair;
 
-template<typename ItemIdType, typename ItemElementType>
-class MPPLSHQuery: public LSHQuery<ItemIdType, ItemElementType, ItemIdType, DenseVector<ItemIdType, ItemElementType>> {
+/*
+ * What an item within the radius sends back to a query: its id, its distance
+ * and its bucket keys, so that the query expands the search without the item
+ * vector and without hashing it again.
+ * */
+template<typename ItemIdType>
+struct MPPLSHHit {
+    ItemIdType itemId;
+    float dist;
+    vector<BucketKey> buckets;
+};
+
+template<typename ItemIdType>
+husky::BinStream& operator<<(husky::BinStream& stream, const MPPLSHHit<ItemIdType>& hit) {
+    stream << hit.itemId << hit.dist << hit.buckets;
+    return stream;
+}
+
+template<typename ItemIdType>
+husky::BinStream& operator>>(husky::BinStream& stream, MPPLSHHit<ItemIdType>& hit) {
+    stream >> hit.itemId >> hit.dist >> hit.buckets;
+    return stream;
+}
+
+template<typename ItemIdType, typename ItemElementType,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
+class MPPLSHQuery: public LSHQuery<ItemIdType, ItemElementType, ItemIdType, MPPLSHHit<ItemIdType>, FactoryType> {
 public:
     unsigned iteration = 0;
-    std::set<ItemIdType> evaluated;
+    // items already reported and buckets already probed
+    std::unordered_set<ItemIdType> evaluated;
+    std::unordered_set<BucketKey> probed;
     explicit MPPLSHQuery(
-        const typename MPPLSHQuery::KeyT& id):LSHQuery<ItemIdType, ItemElementType, ItemIdType, DenseVector<ItemIdType, ItemElementType>>(id) {}
+        const typename MPPLSHQuery::KeyT& id):LSHQuery<ItemIdType, ItemElementType, ItemIdType, MPPLSHHit<ItemIdType>, FactoryType>(id) {}
 
     void query(
-        LSHFactory<ItemIdType, ItemElementType>& fty,
-        const vector<DenseVector<ItemIdType, ItemElementType>>& inMsg) override {
+        FactoryType& fty,
+        const vector<MPPLSHHit<ItemIdType>>& inMsg) override {
 
         if (iteration == 0) {
             this->queryMsg = this->getItemId();
-            for (auto& bId : fty.calItemBuckets(this->getQuery())) {
-                this->sendToBucket(bId);
-            }
+            this->sendToBuckets(fty, this->getItemVector());
+            probed.insert(this->query_msg_buffer.begin(), this->query_msg_buffer.end());
         } else {
-            for (const auto& item : inMsg) {
+            for (const auto& hit : inMsg) {
                 // check duplication
-                ItemIdType itemId = item.getItemId();
-                if (evaluated.find(itemId) != evaluated.end())
+                if (!evaluated.insert(hit.itemId).second)
                     continue;
-                evaluated.insert(itemId);
 
                 // collect to HDFS
-                float dist = fty.calDist(item.getItemVector(), this->getItemVector());
-                writeHDFSTriplet(this->getItemId(), std::make_pair(itemId, dist), "hdfs_namenode", "hdfs_namenode_port", "outputPath");
+                writeHDFSTriplet(this->getItemId(), std::make_pair(hit.itemId, hit.dist), "hdfs_namenode", "hdfs_namenode_port", "outputPath");
 
-                // issue new queries
-                for (auto& bId : fty.calItemBuckets(item)) {
-                    this->sendToBucket(bId);
+                // issue new queries, a probed bucket only holds items that already answered
+                for (const auto& bId : hit.buckets) {
+                    if (probed.insert(bId).second)
+                        this->sendToBucket(bId);
                 }
             }
         }
@@ -53,20 +79,30 @@ public:
     }
 };
 
-template<typename ItemIdType, typename ItemElementType>
-class MPPLSHItem: public LSHItem<ItemIdType, ItemElementType, ItemIdType, DenseVector<ItemIdType, ItemElementType>> {
+template<typename ItemIdType, typename ItemElementType,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
+class MPPLSHItem: public LSHItem<ItemIdType, ItemElementType, ItemIdType, MPPLSHHit<ItemIdType>, FactoryType> {
 public:
-    explicit MPPLSHItem(const typename MPPLSHItem::KeyT& id):LSHItem<ItemIdType, ItemElementType, ItemIdType, DenseVector<ItemIdType, ItemElementType>>(id){}
+    explicit MPPLSHItem(const typename MPPLSHItem::KeyT& id):LSHItem<ItemIdType, ItemElementType, ItemIdType, MPPLSHHit<ItemIdType>, FactoryType>(id){}
 
-    virtual void answer(LSHFactory<ItemIdType, ItemElementType>& factory, const vector<ItemIdType>& inMsgs) override {
+    virtual void answer(FactoryType& factory, const vector<ItemIdType>& inMsgs) override {
 
-        for (const auto& queryId : inMsgs)
-        {
-            const auto& queryVector = factory.getQueryVector(queryId);
-            float distance = factory.calDist(queryVector, this->getItemVector());
-            if (distance <= 0.9) {
-                this->sendToQuery(queryId, this->getItem());
-            }
+        ScopedScatter<ItemSpan<ItemElementType>> scatter(this->getItemSpan(), inMsgs.size() > 1);
+        size_t n = this->calQueryDistsWithin(factory, inMsgs);
+        if (n == 0) return;
+
+        // hashed on the first hit only, most items are never within the radius of a query
+        if (_buckets.empty()) {
+            _buckets.resize(factory.getNumTables());
+            factory.calBucketsInto(this->getItemSpan(), _buckets.data());
+        }
+        MPPLSHHit<ItemIdType> hit{this->getItemId(), 0, _buckets};
+        for (size_t i = 0; i < n; ++i) {
+            hit.dist = this->batch_dists[i];
+            this->sendToQuery(this->batch_query_ids[i], hit);
         }
     }
+
+private:
+    vector<BucketKey> _buckets;
 };
@@ -17,11 +17,12 @@ typedef int ItemIdType;
 typedef std::pair<int, float> ItemElementType;
 typedef ItemIdType QueryMsg;
 typedef std::pair<ItemIdType, float> AnswerMsg;
-typedef DefaultQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Query;
-typedef PLSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Item;
-typedef DefaultBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Bucket;
+typedef APSparseSimHashFactory<int, float> Factory;
+typedef DefaultQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Query;
+typedef PLSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Item;
+typedef DefaultBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Bucket;
 
-APSparseSimHashFactory<int, float> factory;
+Factory factory;
 std::once_flag factory_flag;
 
 void lsh() {
@@ -32,12 +33,20 @@ void lsh() {
     int dimension = std::stoi(husky::Context::get_param("dimension"));
     std::call_once(factory_flag, [&]() {
         factory.initialize(band, row, dimension);
+        configureRadiusMode(factory, 0.9);
+        configureAttributes(factory);
     });
 
     std::string itemPath = husky::Context::get_param("itemPath");
     std::string queryPath = husky::Context::get_param("queryPath");
-    auto& lineInputFormat = husky::io::InputFormatStore::create_line_inputformat();
-    loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdLibsvm, lineInputFormat, itemPath, queryPath);
+    // items and queries are either both idsvecs or both idlibsvm
+    if (isIdSvecsPath(itemPath)) {
+        auto& binaryInputFormat = husky::io::InputFormatStore::create_chunk_inputformat(kIdSvecsBlockBytes);
+        loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdSvecs, binaryInputFormat, itemPath, queryPath);
+    } else {
+        auto& lineInputFormat = husky::io::InputFormatStore::create_line_inputformat();
+        loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdLibsvm, lineInputFormat, itemPath, queryPath);
+    }
 }
 
 int main(int argc, char ** argv) {
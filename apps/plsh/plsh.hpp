@@ -1,34 +1,30 @@
 #pragma once
-#include <unordered_set>
 
 #include "core/engine.hpp"
 #include "io/hdfs_manager.hpp"
 
+#include "losha/common/sparsekernel.hpp"
 #include "lshcore/lshitem.hpp"
 using namespace husky::losha;
 using std::vector;
 
-template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg>
-class PLSHItem : public LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> 
+template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
+class PLSHItem : public LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType> 
 {
 public:
-    explicit PLSHItem(const typename PLSHItem::KeyT& id) : LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>(id){}
+    explicit PLSHItem(const typename PLSHItem::KeyT& id) : LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>(id){}
 
     virtual void answer(
-        LSHFactory<ItemIdType, ItemElementType>& factory,
+        FactoryType& factory,
         const vector<QueryMsg>& inMsgs) {
 
-        std::unordered_set<QueryMsg> evaluated;
-        for (auto& queryId : inMsgs) {
-
-            if (evaluated.find(queryId)!= evaluated.end()) continue;
-            evaluated.insert(queryId);
-
-            const auto& queryVector = factory.getQueryVector(queryId);
-            float distance = factory.calDist(queryVector, this->getItemVector());
-
-            if (distance <= 0.9)
-                writeHDFSTriplet(queryId, this->getItemId(), distance, "hdfs_namenode", "hdfs_namenode_port", "outputPath");
+        // the item is multiplied with every query it received
+        ScopedScatter<ItemSpan<ItemElementType>> scatter(this->getItemSpan(), inMsgs.size() > 1);
+        // only the queries within the radius are left
+        size_t n = this->calQueryDistsWithin(factory, inMsgs);
+        for (size_t i = 0; i < n; ++i) {
+            writeHDFSTriplet(this->batch_query_ids[i], this->getItemId(), this->batch_dists[i], "hdfs_namenode", "hdfs_namenode_port", "outputPath");
         }
     }
 };
@@ -13,17 +13,20 @@
 using namespace husky::losha;
 
 typedef int ItemIdType;
-typedef float ItemElementType;
 typedef ItemIdType QueryMsg;
-typedef std::pair<ItemIdType, ItemElementType> AnswerMsg;
-typedef DefaultQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Query;
-typedef DefaultItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Item;
-typedef DefaultBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> Bucket;
+typedef std::pair<ItemIdType, float> AnswerMsg;
 
-SimHashFactory<ItemIdType, ItemElementType> factory;
-std::once_flag factory_flag;
+// ItemElementType is float for idfvecs and uint8_t for idbvecs
+template<typename ItemElementType>
+void lshOn(
+    void (*setItem)(boost::string_ref&, ItemIdType&, std::vector<ItemElementType>&)) {
 
-void lsh() {
+    typedef SimHashFactory<ItemIdType, ItemElementType> Factory;
+    typedef DefaultQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Query;
+    typedef DefaultItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Item;
+    typedef DefaultBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, Factory> Bucket;
+    static Factory factory;
+    static std::once_flag factory_flag;
 
     // initialization
     int band = std::stoi(husky::Context::get_param("band"));
@@ -31,13 +34,28 @@ void lsh() {
     int dimension = std::stoi(husky::Context::get_param("dimension"));
     std::call_once(factory_flag, [&]() {
         factory.initialize(band, row, dimension);
+        configureAttributes(factory);
     });
 
-    int BytesPerVector = dimension * 4 + 8;
+    int BytesPerVector = dimension * sizeof(ItemElementType) + 8;
     std::string itemPath = husky::Context::get_param("itemPath");
     std::string queryPath = husky::Context::get_param("queryPath");
-    auto& binaryInputFormat = husky::io::InputFormatStore::create_chunk_inputformat(BytesPerVector); 
-    loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, parseIdFvecs, binaryInputFormat, itemPath, queryPath);
+    // file:// paths are mmap'ed locally instead of read from HDFS
+    if (MmapInputFormat::isLocalPath(itemPath)) {
+        MmapInputFormat mmapInputFormat(BytesPerVector);
+        loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, setItem, mmapInputFormat, itemPath, queryPath);
+    } else {
+        auto& binaryInputFormat = husky::io::InputFormatStore::create_chunk_inputformat(BytesPerVector);
+        loshaengine<Query, Bucket, Item, QueryMsg, AnswerMsg>(factory, setItem, binaryInputFormat, itemPath, queryPath);
+    }
+}
+
+void lsh() {
+    if (isBvecsPath(husky::Context::get_param("itemPath"))) {
+        lshOn<uint8_t>(parseIdBvecs);
+    } else {
+        lshOn<float>(parseIdFvecs);
+    }
 }
 
 int main(int argc, char ** argv) {
@@ -2,6 +2,8 @@
 #include <vector>
 #include <cmath>
 #include <utility>
+
+#include "losha/common/sparsekernel.hpp"
 namespace husky{
 namespace losha {
 
@@ -14,6 +16,25 @@ float calL2Norm(const std::vector<std::pair<int, T>>& vector) {
     return sqrt(dist);
 }
 
+template<typename T>
+float calL2Norm(const SparseVector<T>& vector) {
+    return sqrt(sparseSquareNorm(vector));
+}
+
+template<typename T>
+float calL2Norm(SparseSpan<T> vector) {
+    return sqrt(sparseSquareNorm(vector));
+}
+
+template<typename T>
+float calL2Norm(Span<const T> vector) {
+    float dist = 0;
+    for (size_t i = 0; i < vector.size(); ++i) {
+        dist += vector[i] * vector[i];
+    }
+    return sqrt(dist);
+}
+
 template<typename T>
 float calL2Norm(const std::vector<T>& vector) {
     float dist = 0;
@@ -1,6 +1,7 @@
 #pragma once
 #include <vector>
 #include <cmath>
+#include <limits>
 #include "losha/common/dotproduct.hpp"
 #include "losha/common/algebra.hpp"
 using namespace std;
@@ -8,25 +9,182 @@ using namespace std;
 namespace husky {
 namespace losha {
 
+// takes views so that owned vectors and items in the ItemStore share one
+// function, callers bind it to std::function
 inline float calSquareE2Dist(
-        const std::vector<float> & queryVector,
-        const std::vector<float> & itemVector) {
+        Span<const float> queryVector,
+        Span<const float> itemVector) {
 
     assert(queryVector.size() == itemVector.size());
+    const float* q = queryVector.data();
+    const float* v = itemVector.data();
     float distance = 0;
-    for (int i = 0; i < queryVector.size(); ++i) {
-        distance += (queryVector[i] - itemVector[i]) * (queryVector[i] - itemVector[i]);
+    for (size_t i = 0; i < queryVector.size(); ++i) {
+        distance += (q[i] - v[i]) * (q[i] - v[i]);
     }
     return distance;
 }
 
 inline float calE2Dist(
-        const std::vector<float> & queryVector,
-        const std::vector<float> & itemVector) {
+        Span<const float> queryVector,
+        Span<const float> itemVector) {
 
     return sqrt(calSquareE2Dist(queryVector, itemVector));
 }
 
+// exact squared distance of uint8 features (bvecs) in integer arithmetic
+inline uint64_t calIntSquareE2Dist(
+        Span<const uint8_t> queryVector,
+        Span<const uint8_t> itemVector) {
+
+    assert(queryVector.size() == itemVector.size());
+    const uint8_t* q = queryVector.data();
+    const uint8_t* v = itemVector.data();
+    uint64_t distance = 0;
+    for (size_t start = 0; start < queryVector.size(); start += kUint8BlockSize) {
+        size_t end = std::min(queryVector.size(), start + kUint8BlockSize);
+        uint32_t block = 0;
+        for (size_t i = start; i < end; ++i) {
+            int diff = static_cast<int>(q[i]) - static_cast<int>(v[i]);
+            block += diff * diff;
+        }
+        distance += block;
+    }
+    return distance;
+}
+
+inline float calE2Dist(
+        Span<const uint8_t> queryVector,
+        Span<const uint8_t> itemVector) {
+
+    return sqrt(static_cast<float>(calIntSquareE2Dist(queryVector, itemVector)));
+}
+
+// dimensions summed between two checks of an early-abandoning distance
+const size_t kAbandonBlock = 16;
+
+/*
+ * Early-abandoning calE2Dist: once the partial sum of squares passes
+ * bound^2 it returns infinity, otherwise the exact calE2Dist. The bound gets
+ * a few ulps of slack so that no distance <= bound is abandoned.
+ * */
+inline float calE2DistBounded(
+        Span<const float> queryVector,
+        Span<const float> itemVector,
+        float bound) {
+
+    if (bound >= std::numeric_limits<float>::max()) {
+        return calE2Dist(queryVector, itemVector);
+    }
+    assert(queryVector.size() == itemVector.size());
+    const float* q = queryVector.data();
+    const float* v = itemVector.data();
+    float limit = bound * bound * (1 + 1e-6f);
+    float distance = 0;
+    for (size_t start = 0; start < queryVector.size(); start += kAbandonBlock) {
+        size_t end = std::min(queryVector.size(), start + kAbandonBlock);
+        for (size_t i = start; i < end; ++i) {
+            distance += (q[i] - v[i]) * (q[i] - v[i]);
+        }
+        if (distance > limit) return std::numeric_limits<float>::infinity();
+    }
+    return sqrt(distance);
+}
+
+inline float calE2DistBounded(
+        Span<const uint8_t> queryVector,
+        Span<const uint8_t> itemVector,
+        float bound) {
+
+    if (bound >= std::numeric_limits<float>::max()) {
+        return calE2Dist(queryVector, itemVector);
+    }
+    assert(queryVector.size() == itemVector.size());
+    const uint8_t* q = queryVector.data();
+    const uint8_t* v = itemVector.data();
+    double limit = static_cast<double>(bound) * bound * (1 + 1e-6);
+    uint64_t distance = 0;
+    for (size_t start = 0; start < queryVector.size(); start += kAbandonBlock) {
+        size_t end = std::min(queryVector.size(), start + kAbandonBlock);
+        for (size_t i = start; i < end; ++i) {
+            int diff = static_cast<int>(q[i]) - static_cast<int>(v[i]);
+            distance += diff * diff;
+        }
+        if (distance > limit) return std::numeric_limits<float>::infinity();
+    }
+    return sqrt(static_cast<float>(distance));
+}
+
+/*
+ * Distances from one item to a tile of n query vectors of the item's
+ * dimension, four queries per pass so that the item is streamed once per
+ * four queries instead of once per query. Every float distance still sums
+ * its dimensions in order, so the results equal calE2Dist.
+ * */
+inline void calE2Dists(
+        Span<const float> itemVector,
+        const float* const* queries,
+        size_t n,
+        float* out) {
+
+    const float* v = itemVector.data();
+    size_t d = itemVector.size();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const float* q0 = queries[i];
+        const float* q1 = queries[i + 1];
+        const float* q2 = queries[i + 2];
+        const float* q3 = queries[i + 3];
+        float d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+        for (size_t j = 0; j < d; ++j) {
+            float x = v[j];
+            d0 += (q0[j] - x) * (q0[j] - x);
+            d1 += (q1[j] - x) * (q1[j] - x);
+            d2 += (q2[j] - x) * (q2[j] - x);
+            d3 += (q3[j] - x) * (q3[j] - x);
+        }
+        out[i] = sqrt(d0);
+        out[i + 1] = sqrt(d1);
+        out[i + 2] = sqrt(d2);
+        out[i + 3] = sqrt(d3);
+    }
+    for (; i < n; ++i) {
+        out[i] = calE2Dist(Span<const float>(queries[i], d), itemVector);
+    }
+}
+
+inline void calE2Dists(
+        Span<const uint8_t> itemVector,
+        const uint8_t* const* queries,
+        size_t n,
+        float* out) {
+
+    const uint8_t* v = itemVector.data();
+    size_t d = itemVector.size();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint64_t sums[4] = {0, 0, 0, 0};
+        for (size_t start = 0; start < d; start += kUint8BlockSize) {
+            size_t end = std::min(d, start + kUint8BlockSize);
+            uint32_t block[4] = {0, 0, 0, 0};
+            for (size_t j = start; j < end; ++j) {
+                int x = v[j];
+                for (int k = 0; k < 4; ++k) {
+                    int diff = static_cast<int>(queries[i + k][j]) - x;
+                    block[k] += diff * diff;
+                }
+            }
+            for (int k = 0; k < 4; ++k) sums[k] += block[k];
+        }
+        for (int k = 0; k < 4; ++k) {
+            out[i + k] = sqrt(static_cast<float>(sums[k]));
+        }
+    }
+    for (; i < n; ++i) {
+        out[i] = calE2Dist(Span<const uint8_t>(queries[i], d), itemVector);
+    }
+}
+
 float calAngularDist(
         const std::vector<float> & queryVector,
         const std::vector<float> & itemVector,
@@ -62,5 +220,93 @@ float calAngularDist(
 
     return acos(product);
 }
+
+inline float calAngularDist(
+        const SparseVector<float> & queryVector,
+        const SparseVector<float> & itemVector,
+        bool unitNorm = false) {
+
+    float product = dotProduct(queryVector, itemVector);
+
+    if (!unitNorm && product != 0) {
+        product /= calL2Norm(queryVector);
+        product /= calL2Norm(itemVector);
+    }
+    if (product > 1) {
+        product = 1;
+    }
+    else if (product < -1) {
+        product = -1;
+    }
+
+    return acos(product);
+}
+
+template<typename VectorType>
+inline float calAngularDistOfViews(
+        VectorType queryVector,
+        VectorType itemVector,
+        bool unitNorm) {
+
+    float product = dotProduct(queryVector, itemVector);
+
+    if (!unitNorm && product != 0) {
+        product /= calL2Norm(queryVector);
+        product /= calL2Norm(itemVector);
+    }
+    if (product > 1) {
+        product = 1;
+    }
+    else if (product < -1) {
+        product = -1;
+    }
+
+    return acos(product);
+}
+
+// with both L2 norms known in advance, e.g. kept by the query store
+template<typename VectorType>
+inline float calAngularDistWithNorms(
+        VectorType queryVector,
+        VectorType itemVector,
+        float queryNorm,
+        float itemNorm) {
+
+    float product = dotProduct(queryVector, itemVector);
+
+    if (product != 0) {
+        product /= queryNorm;
+        product /= itemNorm;
+    }
+    if (product > 1) {
+        product = 1;
+    }
+    else if (product < -1) {
+        product = -1;
+    }
+
+    return acos(product);
+}
+
+inline float calAngularDist(
+        Span<const float> queryVector,
+        Span<const float> itemVector,
+        bool unitNorm = false) {
+    return calAngularDistOfViews(queryVector, itemVector, unitNorm);
+}
+
+inline float calAngularDist(
+        Span<const uint8_t> queryVector,
+        Span<const uint8_t> itemVector,
+        bool unitNorm = false) {
+    return calAngularDistOfViews(queryVector, itemVector, unitNorm);
+}
+
+inline float calAngularDist(
+        SparseSpan<float> queryVector,
+        SparseSpan<float> itemVector,
+        bool unitNorm = false) {
+    return calAngularDistOfViews(queryVector, itemVector, unitNorm);
+}
 }
 }
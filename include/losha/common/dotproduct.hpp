@@ -1,7 +1,12 @@
 #pragma once
-#include <vector>
-#include <utility>
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "losha/common/sparsekernel.hpp"
+#include "losha/common/span.hpp"
 using std::vector;
 using std::pair;
 
@@ -51,5 +56,96 @@ inline float dotProduct(
     }
     return product;
 }
+
+// for SparseVector
+inline float dotProduct(
+    const std::vector<float>& a,
+    const SparseVector<float>& v2) {
+    return denseSparseDot(a.data(), v2);
+}
+
+// for a view of a dense vector
+inline float dotProduct(
+    const std::vector<float>& a,
+    Span<const float> v2) {
+    assert(a.size() == v2.size());
+    const float* pa = a.data();
+    const float* pv = v2.data();
+    float product = 0;
+    for (size_t i = 0; i < v2.size(); ++i) {
+        product += pa[i] * pv[i];
+    }
+    return product;
+}
+
+// for a view of a SparseVector
+inline float dotProduct(
+    const std::vector<float>& a,
+    SparseSpan<float> v2) {
+    return denseSparseDot(a.data(), v2.indices(), v2.values(), v2.size());
+}
+
+// for SparseVector
+inline float dotProduct(
+    const SparseVector<float>& queryVector,
+    const SparseVector<float>& itemVector) {
+    return sparseDot(queryVector, itemVector);
+}
+
+// for views, e.g. items kept in the ItemStore
+inline float dotProduct(
+    Span<const float> a,
+    Span<const float> v2) {
+    assert(a.size() == v2.size());
+    const float* pa = a.data();
+    const float* pv = v2.data();
+    float product = 0;
+    for (size_t i = 0; i < a.size(); ++i) {
+        product += pa[i] * pv[i];
+    }
+    return product;
+}
+
+inline float dotProduct(
+    SparseSpan<float> queryVector,
+    SparseSpan<float> itemVector) {
+    return sparseDot(queryVector, itemVector);
+}
+
+// for uint8 features (bvecs), widened to float against a float projection
+inline float dotProduct(
+    const std::vector<float>& a,
+    Span<const uint8_t> v2) {
+    assert(a.size() == v2.size());
+    const float* pa = a.data();
+    const uint8_t* pv = v2.data();
+    float product = 0;
+    for (size_t i = 0; i < v2.size(); ++i) {
+        product += pa[i] * static_cast<float>(pv[i]);
+    }
+    return product;
+}
+
+// blocks of 2^16 products of uint8 sum exactly into uint32
+const size_t kUint8BlockSize = 1 << 16;
+
+// exact integer dot product of uint8 features
+inline float dotProduct(
+    Span<const uint8_t> a,
+    Span<const uint8_t> v2) {
+    assert(a.size() == v2.size());
+    const uint8_t* pa = a.data();
+    const uint8_t* pv = v2.data();
+    uint64_t product = 0;
+    for (size_t start = 0; start < a.size(); start += kUint8BlockSize) {
+        size_t end = std::min(a.size(), start + kUint8BlockSize);
+        uint32_t block = 0;
+        for (size_t i = start; i < end; ++i) {
+            block += static_cast<uint32_t>(pa[i]) * pv[i];
+        }
+        product += block;
+    }
+    return product;
+}
 }
 }
@@ -0,0 +1,78 @@
+/*
+ * Non-owning views of item vectors.
+ *
+ * Span<const T> is a (pointer, length) view of a dense vector and
+ * SparseSpan<T> of the two arrays of a SparseVector. Both convert implicitly
+ * from their owning containers, so hash functions written against views
+ * accept vectors as well.
+ * */
+#pragma once
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "losha/common/sparsevector.hpp"
+
+namespace husky {
+namespace losha {
+
+template<typename T>
+class Span {
+public:
+    typedef typename std::remove_const<T>::type ValueType;
+
+    Span() : _data(nullptr), _size(0) {}
+    Span(T* data, size_t size) : _data(data), _size(size) {}
+    Span(const std::vector<ValueType>& v) : _data(v.data()), _size(v.size()) {}
+
+    inline T* data() const { return _data; }
+    inline size_t size() const { return _size; }
+    inline bool empty() const { return _size == 0; }
+    inline T& operator[](size_t i) const { return _data[i]; }
+    inline T* begin() const { return _data; }
+    inline T* end() const { return _data + _size; }
+
+private:
+    T* _data;
+    size_t _size;
+};
+
+template<typename T>
+class SparseSpan {
+public:
+    typedef T ValueType;
+
+    SparseSpan() : _indices(nullptr), _values(nullptr), _size(0) {}
+    SparseSpan(const int* indices, const T* values, size_t size)
+        : _indices(indices), _values(values), _size(size) {}
+    SparseSpan(const SparseVector<T>& v)
+        : _indices(v.indices()), _values(v.values()), _size(v.size()) {}
+
+    inline const int* indices() const { return _indices; }
+    inline const T* values() const { return _values; }
+    inline size_t size() const { return _size; }
+    inline bool empty() const { return _size == 0; }
+
+private:
+    const int* _indices;
+    const T* _values;
+    size_t _size;
+};
+
+// view counterpart of ItemVector
+template<typename ItemElementType>
+struct ItemSpanTrait {
+    typedef Span<const ItemElementType> type;
+};
+
+template<typename T>
+struct ItemSpanTrait<std::pair<int, T>> {
+    typedef SparseSpan<T> type;
+};
+
+template<typename ItemElementType>
+using ItemSpan = typename ItemSpanTrait<ItemElementType>::type;
+
+} // namespace losha
+} // namespace husky
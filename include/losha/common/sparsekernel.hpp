@@ -0,0 +1,234 @@
+/*
+ * Kernels for SparseVector.
+ *
+ * sparse x sparse dot products pick one of three strategies:
+ *   - gather: one side is scattered into the thread local dense scratch
+ *     (ScopedScatter), so the other side is a plain gather, O(nnz)
+ *   - galloping: lengths differ by more than kGallopRatio, every entry of the
+ *     short side is located in the long side by exponential search
+ *   - merge: branch free two pointer merge for similar lengths
+ * */
+#pragma once
+#include <cassert>
+#include <vector>
+
+#include "losha/common/span.hpp"
+#include "losha/common/sparsevector.hpp"
+
+namespace husky {
+namespace losha {
+
+// use galloping once the long side is this many times longer than the short side
+const size_t kGallopRatio = 16;
+
+template<typename T>
+inline float sparseDotMerge(
+    const int* aIdx, const T* aVal, size_t aSize,
+    const int* bIdx, const T* bVal, size_t bSize) {
+
+    // no data dependent branch in the loop body, the compiler turns the
+    // advances and the select into conditional moves
+    float product = 0;
+    size_t i = 0, j = 0;
+    while (i < aSize && j < bSize) {
+        int ia = aIdx[i];
+        int ib = bIdx[j];
+        float p = aVal[i] * bVal[j];
+        product += (ia == ib) ? p : 0.0f;
+        i += (ia <= ib);
+        j += (ib <= ia);
+    }
+    return product;
+}
+
+// first position in [from, size) whose index is >= target
+inline size_t gallop(const int* idx, size_t from, size_t size, int target) {
+    size_t step = 1;
+    size_t lo = from;
+    size_t hi = from;
+    while (hi < size && idx[hi] < target) {
+        lo = hi + 1;
+        hi += step;
+        step <<= 1;
+    }
+    if (hi > size) hi = size;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (idx[mid] < target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// short side (a) drives the search in the long side (b)
+template<typename T>
+inline float sparseDotGallop(
+    const int* aIdx, const T* aVal, size_t aSize,
+    const int* bIdx, const T* bVal, size_t bSize) {
+
+    float product = 0;
+    size_t j = 0;
+    for (size_t i = 0; i < aSize && j < bSize; ++i) {
+        j = gallop(bIdx, j, bSize, aIdx[i]);
+        if (j < bSize && bIdx[j] == aIdx[i]) {
+            product += aVal[i] * bVal[j];
+            ++j;
+        }
+    }
+    return product;
+}
+
+/*
+ * Dense scratch of one thread. A vector that is multiplied with many other
+ * vectors (a query against the items of a bucket, an item against all the
+ * queries it received) is scattered once, afterwards every product is a gather.
+ * Only the scattered entries are reset, so rebinding costs O(nnz).
+ * */
+template<typename T>
+class SparseScratch {
+public:
+    static SparseScratch<T>& local() {
+        static thread_local SparseScratch<T> scratch;
+        return scratch;
+    }
+
+    void bind(SparseSpan<T> v) {
+        unbind();
+        int maxDimension = v.empty() ? 0 : v.indices()[v.size() - 1] + 1;
+        if (_dense.size() < static_cast<size_t>(maxDimension)) {
+            _dense.resize(maxDimension, 0);
+        }
+        const int* idx = v.indices();
+        const T* val = v.values();
+        for (size_t i = 0; i < v.size(); ++i) {
+            _dense[idx[i]] = val[i];
+        }
+        _bound = v;
+        _isBound = true;
+    }
+
+    void unbind() {
+        if (!_isBound) return;
+        const int* idx = _bound.indices();
+        for (size_t i = 0; i < _bound.size(); ++i) {
+            _dense[idx[i]] = 0;
+        }
+        _isBound = false;
+    }
+
+    // identity of the data, so an owned vector and a view of it match
+    inline bool isBoundTo(SparseSpan<T> v) const {
+        return _isBound && _bound.indices() == v.indices() && _bound.size() == v.size();
+    }
+
+    // product of the bound vector and v
+    inline float gather(const int* idx, const T* val, size_t size) const {
+        float product = 0;
+        const T* dense = _dense.data();
+        int limit = _dense.size();
+        for (size_t i = 0; i < size; ++i) {
+            // indices beyond the scratch cannot match the bound vector
+            if (idx[i] >= limit) break;
+            product += dense[idx[i]] * val[i];
+        }
+        return product;
+    }
+
+private:
+    std::vector<T> _dense;
+    SparseSpan<T> _bound;
+    bool _isBound = false;
+};
+
+// binds v to the thread local scratch for the lifetime of the guard;
+// a no-op for dense containers so templates can use it unconditionally
+template<typename VectorType>
+class ScopedScatter {
+public:
+    ScopedScatter(const VectorType& v, bool enable = true) {}
+};
+
+template<typename T>
+class ScopedScatter<SparseSpan<T>> {
+public:
+    ScopedScatter(SparseSpan<T> v, bool enable = true) : _enabled(enable) {
+        if (_enabled) SparseScratch<T>::local().bind(v);
+    }
+    ~ScopedScatter() {
+        if (_enabled) SparseScratch<T>::local().unbind();
+    }
+    ScopedScatter(const ScopedScatter&) = delete;
+    ScopedScatter& operator=(const ScopedScatter&) = delete;
+
+private:
+    bool _enabled;
+};
+
+template<typename T>
+class ScopedScatter<SparseVector<T>> : public ScopedScatter<SparseSpan<T>> {
+public:
+    ScopedScatter(const SparseVector<T>& v, bool enable = true)
+        : ScopedScatter<SparseSpan<T>>(v, enable) {}
+};
+
+template<typename T>
+inline float sparseDot(SparseSpan<T> a, SparseSpan<T> b) {
+    const SparseScratch<T>& scratch = SparseScratch<T>::local();
+    if (scratch.isBoundTo(a)) {
+        return scratch.gather(b.indices(), b.values(), b.size());
+    }
+    if (scratch.isBoundTo(b)) {
+        return scratch.gather(a.indices(), a.values(), a.size());
+    }
+
+    size_t aSize = a.size();
+    size_t bSize = b.size();
+    if (aSize * kGallopRatio < bSize) {
+        return sparseDotGallop(a.indices(), a.values(), aSize, b.indices(), b.values(), bSize);
+    }
+    if (bSize * kGallopRatio < aSize) {
+        return sparseDotGallop(b.indices(), b.values(), bSize, a.indices(), a.values(), aSize);
+    }
+    return sparseDotMerge(a.indices(), a.values(), aSize, b.indices(), b.values(), bSize);
+}
+
+// dense parameter (e.g. a SimHash hyperplane) times a sparse vector
+template<typename T>
+inline float denseSparseDot(const float* a, const int* idx, const T* val, size_t size) {
+    float product = 0;
+    for (size_t i = 0; i < size; ++i) {
+        product += a[idx[i]] * val[i];
+    }
+    return product;
+}
+
+template<typename T>
+inline float sparseDot(const SparseVector<T>& a, const SparseVector<T>& b) {
+    return sparseDot(SparseSpan<T>(a), SparseSpan<T>(b));
+}
+
+template<typename T>
+inline float denseSparseDot(const float* a, const SparseVector<T>& v) {
+    return denseSparseDot(a, v.indices(), v.values(), v.size());
+}
+
+template<typename T>
+inline float sparseSquareNorm(SparseSpan<T> v) {
+    const T* val = v.values();
+    float sum = 0;
+    for (size_t i = 0; i < v.size(); ++i) {
+        sum += val[i] * val[i];
+    }
+    return sum;
+}
+
+template<typename T>
+inline float sparseSquareNorm(const SparseVector<T>& v) {
+    return sparseSquareNorm(SparseSpan<T>(v));
+}
+
+} // namespace losha
+} // namespace husky
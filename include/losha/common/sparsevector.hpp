@@ -0,0 +1,140 @@
+/*
+ * Sparse vector in CSR-like layout: the feature indices and the feature
+ * values of the non-zero entries are kept in two separate arrays sorted by
+ * index, so that the kernels in sparsekernel.hpp can scan indices without
+ * touching values and gather values with a plain pointer walk.
+ * */
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace husky {
+namespace losha {
+
+template<typename T>
+class SparseVector {
+public:
+    typedef T ValueType;
+
+    SparseVector() {}
+
+    // build from the (index, value) array of structures used by text loaders
+    explicit SparseVector(const std::vector<std::pair<int, T>>& pairs) {
+        reserve(pairs.size());
+        for (const auto& p : pairs) {
+            push_back(p.first, p.second);
+        }
+        sortByIndex();
+    }
+
+    inline void push_back(int index, T value) {
+        _indices.push_back(index);
+        _values.push_back(value);
+    }
+
+    inline void reserve(size_t nnz) {
+        _indices.reserve(nnz);
+        _values.reserve(nnz);
+    }
+
+    inline void resize(size_t nnz) {
+        _indices.resize(nnz);
+        _values.resize(nnz);
+    }
+
+    inline void clear() {
+        _indices.clear();
+        _values.clear();
+    }
+
+    inline void swap(SparseVector<T>& other) {
+        _indices.swap(other._indices);
+        _values.swap(other._values);
+    }
+
+    inline void shrink_to_fit() {
+        _indices.shrink_to_fit();
+        _values.shrink_to_fit();
+    }
+
+    // number of non-zero entries
+    inline size_t size() const { return _indices.size(); }
+    inline size_t capacity() const { return _indices.capacity(); }
+    inline bool empty() const { return _indices.empty(); }
+
+    inline int index(size_t i) const { return _indices[i]; }
+    inline T value(size_t i) const { return _values[i]; }
+    inline T& value(size_t i) { return _values[i]; }
+
+    inline const int* indices() const { return _indices.data(); }
+    inline const T* values() const { return _values.data(); }
+    inline int* indices() { return _indices.data(); }
+    inline T* values() { return _values.data(); }
+
+    // largest feature index + 1, 0 for an empty vector
+    inline int getMaxDimension() const {
+        return _indices.empty() ? 0 : _indices.back() + 1;
+    }
+
+    inline bool isSorted() const {
+        return std::is_sorted(_indices.begin(), _indices.end());
+    }
+
+    // kernels assume ascending indices, libsvm input usually already is
+    void sortByIndex() {
+        if (isSorted()) return;
+
+        std::vector<size_t> order(_indices.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return _indices[a] < _indices[b];
+        });
+
+        std::vector<int> indices(order.size());
+        std::vector<T> values(order.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            indices[i] = _indices[order[i]];
+            values[i] = _values[order[i]];
+        }
+        _indices.swap(indices);
+        _values.swap(values);
+    }
+
+    std::vector<std::pair<int, T>> toPairs() const {
+        std::vector<std::pair<int, T>> pairs;
+        pairs.reserve(size());
+        for (size_t i = 0; i < size(); ++i) {
+            pairs.emplace_back(_indices[i], _values[i]);
+        }
+        return pairs;
+    }
+
+    bool operator==(const SparseVector<T>& other) const {
+        return _indices == other._indices && _values == other._values;
+    }
+
+    std::vector<int> _indices;
+    std::vector<T> _values;
+};
+
+// Maps the ItemElementType of an app to the container an item stores.
+// Dense apps use std::vector<ItemElementType>; sparse apps keep declaring
+// ItemElementType as std::pair<int, T> and get a SparseVector<T>.
+template<typename ItemElementType>
+struct ItemVectorTrait {
+    typedef std::vector<ItemElementType> type;
+};
+
+template<typename T>
+struct ItemVectorTrait<std::pair<int, T>> {
+    typedef SparseVector<T> type;
+};
+
+template<typename ItemElementType>
+using ItemVector = typename ItemVectorTrait<ItemElementType>::type;
+
+} // namespace losha
+} // namespace husky
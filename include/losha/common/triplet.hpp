@@ -0,0 +1,35 @@
+/*
+ * Binary result triplets, written with outputFormat=binary:
+ *     [int queryId][int itemId][float distance]
+ * per result, native byte order, no header. Each worker appends to its own
+ * shard of outputPath, tools/evaluate_triplets reads the shards back.
+ * */
+#pragma once
+#include <cstring>
+#include <string>
+
+namespace husky {
+namespace losha {
+
+const int kTripletBytes = 2 * sizeof(int) + sizeof(float);
+
+inline void encodeTriplet(int queryId, int itemId, float distance, char* out) {
+    memcpy(out, &queryId, sizeof(int));
+    memcpy(out + sizeof(int), &itemId, sizeof(int));
+    memcpy(out + 2 * sizeof(int), &distance, sizeof(float));
+}
+
+inline void decodeTriplet(const char* in, int& queryId, int& itemId, float& distance) {
+    memcpy(&queryId, in, sizeof(int));
+    memcpy(&itemId, in + sizeof(int), sizeof(int));
+    memcpy(&distance, in + 2 * sizeof(int), sizeof(float));
+}
+
+inline std::string binaryTriplet(int queryId, int itemId, float distance) {
+    std::string record(kTripletBytes, '\0');
+    encodeTriplet(queryId, itemId, distance, &record[0]);
+    return record;
+}
+
+} // namespace losha
+} // namespace husky
@@ -4,6 +4,7 @@
 #include<utility>
 #include "core/engine.hpp"
 #include "io/hdfs_manager.hpp"
+#include "losha/common/triplet.hpp"
 
 using std::string;
 using std::pair;
@@ -21,10 +22,20 @@ void writeHDFS(const string& text, const string& namenodeKey, const string& port
         husky::Context::get_global_tid());
 }
 
+// outputFormat=binary switches the triplets to the binary layout of triplet.hpp
+inline bool isBinaryOutput() {
+    static const bool binary = husky::Context::get_param("outputFormat") == "binary";
+    return binary;
+}
+
 template<typename ItemIdType>
 void writeHDFSTriplet(
     const ItemIdType& queryId, const ItemIdType& itemId, float distance,
     const string& namenodeKey, const string& portKey, const string& outputPathKey) {
+    if (isBinaryOutput()) {
+        writeHDFS(binaryTriplet(queryId, itemId, distance), namenodeKey, portKey, outputPathKey);
+        return;
+    }
     string text = std::to_string(queryId) + " ";
     text += std::to_string(itemId) + " " + std::to_string(distance) + "\n";
     writeHDFS(text, namenodeKey, portKey, outputPathKey);
@@ -48,6 +59,14 @@ void writeHDFSPairVector(
     const IdType& queryId,
     const vector<pair<FirstT, SecondT>>& vec,
     const string& namenodeKey, const string& portKey, const string& outputPathKey) {
+    if (isBinaryOutput()) {
+        string records;
+        for (int i = 0; i < vec.size(); ++i) {
+            records += binaryTriplet(queryId, vec[i].first, vec[i].second);
+        }
+        writeHDFS(records, namenodeKey, portKey, outputPathKey);
+        return;
+    }
     string text = std::to_string(queryId);
     for (int i = 0; i < vec.size(); ++i) {
         text += " ";
@@ -12,43 +12,49 @@
 #include "lshcore/lshitem.hpp"
 using namespace husky::losha;
 
-template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg>
-class DefaultQuery : public LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> {
+template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
+class DefaultQuery : public LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType> {
 public:
-    explicit DefaultQuery(const typename DefaultQuery::KeyT& id):LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>(id) {}
-    void query(LSHFactory<ItemIdType, ItemElementType>& fty, const vector<AnswerMsg>& inMsg) override {
+    explicit DefaultQuery(const typename DefaultQuery::KeyT& id):LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>(id) {}
+    void query(FactoryType& fty, const vector<AnswerMsg>& inMsg) override {
 
         this->queryMsg = this->getItemId();
-        for (auto& bId : fty.calItemBuckets(this->getQuery())) {
-            this->sendToBucket(bId);
-        }
+        this->sendToBuckets(fty, this->getItemVector());
     }
 };
 
-template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg>
-class DefaultItem : public LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> {
+template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
+class DefaultItem : public LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType> {
 public:
-    explicit DefaultItem(const typename DefaultItem::KeyT& id):LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>(id){}
-    DefaultItem() : LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>() {}
-
-    virtual void answer(LSHFactory<ItemIdType, ItemElementType>& factory, const vector<QueryMsg>& inMsgs) {
-
-        std::unordered_set<QueryMsg> evaluated;
-        for (auto& queryId : inMsgs) {
-
-            if (evaluated.find(queryId)!= evaluated.end()) continue;
-            evaluated.insert(queryId);
+    explicit DefaultItem(const typename DefaultItem::KeyT& id):LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>(id){}
+    DefaultItem() : LSHItem<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>() {}
 
-            const auto& queryVector = factory.getQueryVector(queryId);
-            float distance = factory.calDist(queryVector, this->getItemVector());
+    virtual void answer(FactoryType& factory, const vector<QueryMsg>& inMsgs) {
 
-            writeHDFSTriplet(queryId, this->getItemId(), distance, "hdfs_namenode", "hdfs_namenode_port", "outputPath");
+        // with re-ranking the exact distances come in flushAnswers
+        if (factory.getReranker().enabled()) {
+            this->offerForRerank(factory, inMsgs);
+            return;
         }
+        size_t n = this->calQueryDists(factory, inMsgs);
+        for (size_t i = 0; i < n; ++i) {
+            writeHDFSTriplet(this->batch_query_ids[i], this->getItemId(), this->batch_dists[i], "hdfs_namenode", "hdfs_namenode_port", "outputPath");
+        }
+    }
+
+    static void flushAnswers(FactoryType& factory) {
+        if (!factory.getReranker().enabled()) return;
+        DefaultItem::flushRerank(factory, [](const ItemIdType& queryId, const ItemIdType& itemId, float dist) {
+            writeHDFSTriplet(queryId, itemId, dist, "hdfs_namenode", "hdfs_namenode_port", "outputPath");
+        });
     }
 };
 
-template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg>
-class DefaultBucket: public LSHBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg> {
+template<typename ItemIdType, typename ItemElementType, typename QueryMsg, typename AnswerMsg,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
+class DefaultBucket: public LSHBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType> {
 public:
-    explicit DefaultBucket(const typename DefaultBucket::KeyT& bId):LSHBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>(bId){}
+    explicit DefaultBucket(const typename DefaultBucket::KeyT& bId):LSHBucket<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>(bId){}
 };
@@ -1,74 +1,200 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
 #include <iostream>
 #include <cstring>
 #include <fstream>
+#include <random>
+#include <utility>
 #include <vector>
 #include <string>
 
 #include "lshbox/utils.h"
+#include "lshcore/loader/idsvecs.hpp"
+#include "tools/threadpool.h"
 using namespace std;
+using namespace husky::losha;
 
 void alertOutputFormatError() {
     cout << "output format error!" << std::endl;
-    cout << "we currently only support outputs in fvecs or idfvecs" << std::endl;
-    cout << "please provide a output path that ends with fvecs or idfvecs such as data_query.fvecs" << std::endl;
+    cout << "we currently support fixed size records (idfvecs, fvecs, idbvecs, bvecs) and sparse ones (idlibsvm, idsvecs)" << std::endl;
+    cout << "please provide an output path with the format of the input such as data_query.idfvecs" << std::endl;
 }
 
-void sampleIdFVECS(const char* base_file, int num_samples, const char* output_file) {
-    ifstream fin(base_file, ios::binary | ios::ate);
-    if (!fin) {
+string extension(const string& fileName) {
+    size_t dot = fileName.rfind('.');
+    return dot == string::npos ? "" : fileName.substr(dot + 1);
+}
+
+/*
+ * Fixed size records: the sampled indices are sorted and only their records
+ * are read with pread, in parallel, instead of scanning the whole base.
+ * headerBytes is the part before the dimension (4 for the id of idfvecs/idbvecs),
+ * elementBytes the size of one element.
+ * */
+void sampleFixedRecords(const char* base_file, int headerBytes, int elementBytes,
+        int num_samples, const char* output_file, int numThreads) {
+    int fd = open(base_file, O_RDONLY);
+    if (fd == -1) {
         cout << "cannot open file " << base_file << endl;
         assert(false);
     }
-
-    unsigned fileSize = fin.tellg();
+    struct stat st;
+    fstat(fd, &st);
+    size_t fileSize = st.st_size;
     assert(fileSize != 0);
 
-    fin.seekg(0, fin.beg);
-    int id;
     int dimension;
-    fin.read((char*)(&id), sizeof(int));
-    fin.read((char*)(&dimension), sizeof(int));
-
-    unsigned bytesPerRecord = dimension * sizeof(float) + 8;
+    ssize_t n = pread(fd, &dimension, sizeof(int), headerBytes);
+    assert(n == sizeof(int));
+    size_t bytesPerRecord = headerBytes + sizeof(int) + dimension * elementBytes;
     assert(fileSize % bytesPerRecord == 0);
-    int cardinality = fileSize / bytesPerRecord;
+    size_t cardinality = fileSize / bytesPerRecord;
+
     auto selected = sampleRand(cardinality, num_samples);
+    vector<size_t> indices(selected.begin(), selected.end());
+    sort(indices.begin(), indices.end());
 
-    fin.seekg(0, fin.beg);
-    char* buffer = new char[bytesPerRecord];
+    // each task reads a run of ascending offsets
+    vector<char> buffer(indices.size() * bytesPerRecord);
+    const size_t kChunk = 256;
+    int numChunks = (indices.size() + kChunk - 1) / kChunk;
+    ThreadPool pool(numThreads);
+    pool.parallelFor(numChunks, [&](int chunk) {
+        size_t end = min(indices.size(), (chunk + 1) * kChunk);
+        for (size_t i = chunk * kChunk; i < end; ++i) {
+            char* dst = &buffer[i * bytesPerRecord];
+            size_t done = 0;
+            while (done < bytesPerRecord) {
+                size_t offset = indices[i] * bytesPerRecord + done;
+                ssize_t r = pread(fd, dst + done, bytesPerRecord - done, offset);
+                if (r <= 0) {
+                    // a short file or a read error, either would loop forever
+                    cerr << "cannot read " << base_file << " at offset " << offset
+                        << (r == 0 ? ": unexpected end of file" : string(": ") + strerror(errno)) << endl;
+                    exit(EXIT_FAILURE);
+                }
+                done += r;
+            }
+        }
+    });
+    close(fd);
 
     ofstream fout(output_file, ios::binary);
     if (!fout) {
         cout << "cannot open file " << output_file << endl;
         assert(false);
     }
+    fout.write(buffer.data(), buffer.size());
+    fout.close();
+    cout << indices.size() << " of " << cardinality << " items selected" << endl;
+    cout << "sampled base vectors are written into " << output_file << endl;
+}
 
-    unsigned index = 0;
-    while (fin.read((char*)buffer, bytesPerRecord)) {
-        if (selected.find(index) != selected.end()) {
-            cout << index << " th item selected" << endl;
-            fout.write((char*)buffer, bytesPerRecord);
+/*
+ * Variable length records have no offsets to compute, so they are reservoir
+ * sampled in one pass. Records are written in their order in the base.
+ * */
+template<typename RecordT, typename ReadT, typename WriteT>
+void reservoirSample(size_t num_samples, ReadT read, WriteT write) {
+    mt19937 gen(random_device{}());
+    vector<pair<size_t, RecordT>> reservoir;
+    reservoir.reserve(num_samples);
+    RecordT record;
+    size_t index = 0;
+    for (; read(record); ++index) {
+        if (reservoir.size() < num_samples) {
+            reservoir.emplace_back(index, record);
+        } else {
+            size_t slot = uniform_int_distribution<size_t>(0, index)(gen);
+            if (slot < num_samples) reservoir[slot] = make_pair(index, record);
         }
-        index++;
     }
+    sort(reservoir.begin(), reservoir.end(),
+        [](const pair<size_t, RecordT>& a, const pair<size_t, RecordT>& b) {
+        return a.first < b.first;
+    });
+    for (const auto& r : reservoir) {
+        write(r.second);
+    }
+    cout << reservoir.size() << " of " << index << " items selected" << endl;
+}
 
+void sampleIdLIBSVM(const char* base_file, int num_samples, const char* output_file) {
+    ifstream fin(base_file);
+    ofstream fout(output_file);
+    if (!fin || !fout) {
+        cout << "cannot open file " << (fin ? output_file : base_file) << endl;
+        assert(false);
+    }
+    reservoirSample<string>(num_samples,
+        [&](string& line) {
+            while (getline(fin, line)) {
+                if (!line.empty()) return true;
+            }
+            return false;
+        },
+        [&](const string& line) { fout << line << "\n"; });
+    cout << "sampled base vectors are written into " << output_file << endl;
+}
+
+void sampleIdSvecs(const char* base_file, int num_samples, const char* output_file) {
+    ifstream fin(base_file, ios::binary);
+    if (!fin) {
+        cout << "cannot open file " << base_file << endl;
+        assert(false);
+    }
+    IdSvecsReader reader(fin);
+    IdSvecsWriter writer(output_file);
+    if (!writer.good()) {
+        cout << "cannot open file " << output_file << endl;
+        assert(false);
+    }
+    typedef pair<int, SparseVector<float>> Record;
+    reservoirSample<Record>(num_samples,
+        [&](Record& r) { return reader.next(r.first, r.second); },
+        [&](const Record& r) { writer.write(r.first, r.second); });
+    writer.close();
     cout << "sampled base vectors are written into " << output_file << endl;
-    fout.close();
-    fin.close();
 }
 
 int main(int argc, char ** argv) {
-    if (argc != 4) {
-        cout << "Usage: ./sample_queries input_base_fvecs num_samples output_file" << endl;
+    if (argc != 4 && argc != 5) {
+        cout << "Usage: ./sample_base input_base num_samples output_file [num_threads=4]" << endl;
+        return -1;
     }
 
-    const char* baseFile = argv[1];
+    string baseFile = argv[1];
     int numSamples = stoi(argv[2]);
     string outputFile = argv[3];
-    if (outputFile.size() < 7 
-        || (outputFile.substr(outputFile.size() - 5, 5) != "fvecs" && outputFile.substr(outputFile.size() - 7, 7) != "idfvecs")) {
-        alertOutputFormatError();
+    int numThreads = argc == 5 ? stoi(argv[4]) : 4;
+
+    // suffix, bytes before the dimension, bytes per element; variable length formats have none
+    const vector<pair<string, pair<int, int>>> formats = {
+        {"idfvecs", {4, 4}}, {"fvecs", {0, 4}}, {"idbvecs", {4, 1}}, {"bvecs", {0, 1}},
+        {"idlibsvm", {-1, 0}}, {"idsvecs", {-1, 0}}};
+    for (const auto& format : formats) {
+        if (extension(baseFile) != format.first) continue;
+        if (extension(outputFile) != format.first) {
+            alertOutputFormatError();
+            return -1;
+        }
+        int headerBytes = format.second.first;
+        if (headerBytes >= 0) {
+            sampleFixedRecords(baseFile.c_str(), headerBytes, format.second.second,
+                numSamples, outputFile.c_str(), numThreads);
+        } else if (format.first == "idlibsvm") {
+            sampleIdLIBSVM(baseFile.c_str(), numSamples, outputFile.c_str());
+        } else {
+            sampleIdSvecs(baseFile.c_str(), numSamples, outputFile.c_str());
+        }
+        return 0;
     }
-    sampleIdFVECS(baseFile, numSamples, outputFile.c_str());
-    return 0;
+    alertOutputFormatError();
+    return -1;
 }
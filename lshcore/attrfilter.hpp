@@ -0,0 +1,175 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/log.hpp"
+#include "base/serialization.hpp"
+
+#include "boundedquerymsg.hpp"
+
+namespace husky {
+namespace losha {
+
+// compact attribute record of an item
+struct ItemAttributes {
+    int32_t tenant = 0;
+    int32_t language = 0;
+    int64_t time = 0;
+
+    ItemAttributes() {}
+    ItemAttributes(int32_t t, int32_t l, int64_t tm) : tenant(t), language(l), time(tm) {}
+};
+
+inline husky::BinStream& operator<<(husky::BinStream& stream, const ItemAttributes& attrs) {
+    stream << attrs.tenant << attrs.language << attrs.time;
+    return stream;
+}
+
+inline husky::BinStream& operator>>(husky::BinStream& stream, ItemAttributes& attrs) {
+    stream >> attrs.tenant >> attrs.language >> attrs.time;
+    return stream;
+}
+
+/*
+ * Object of the attribute record of an item on the hash owner of its id. The
+ * record and the requests of the item only meet there as messages, so no
+ * process holds the attributes of items it does not load.
+ * */
+template<typename ItemIdType>
+class AttrRecord {
+public:
+    using KeyT = ItemIdType;
+    KeyT itemId_;
+
+    explicit AttrRecord(const KeyT& itemId): itemId_(itemId) {}
+    const KeyT& id() const { return itemId_;}
+};
+
+// filter of a query: kAny matches every tenant or language, time is inclusive
+struct AttrPredicate {
+    static const int32_t kAny = -1;
+    int32_t tenant = kAny;
+    int32_t language = kAny;
+    int64_t timeMin = std::numeric_limits<int64_t>::min();
+    int64_t timeMax = std::numeric_limits<int64_t>::max();
+
+    inline bool accepts(const ItemAttributes& attrs) const {
+        return (tenant == kAny || tenant == attrs.tenant)
+            && (language == kAny || language == attrs.language)
+            && timeMin <= attrs.time && attrs.time <= timeMax;
+    }
+};
+
+/*
+ * Attributes of all items of a bucket: a 64-bit bitmap per categorical
+ * attribute, value v setting bit v % 64, and the range of times. A bucket
+ * whose summary cannot match a predicate forwards nothing; the converse
+ * does not hold, since tenants or languages may share a bit.
+ * */
+struct AttrSummary {
+    uint64_t tenants = 0;
+    uint64_t languages = 0;
+    int64_t timeMin = std::numeric_limits<int64_t>::max();
+    int64_t timeMax = std::numeric_limits<int64_t>::min();
+
+    static inline uint64_t bit(int32_t value) {
+        return 1ULL << (static_cast<uint32_t>(value) % 64);
+    }
+
+    inline void add(const ItemAttributes& attrs) {
+        tenants |= bit(attrs.tenant);
+        languages |= bit(attrs.language);
+        timeMin = std::min(timeMin, attrs.time);
+        timeMax = std::max(timeMax, attrs.time);
+    }
+
+    inline bool mayMatch(const AttrPredicate& pred) const {
+        return (pred.tenant == AttrPredicate::kAny || (tenants & bit(pred.tenant)))
+            && (pred.language == AttrPredicate::kAny || (languages & bit(pred.language)))
+            && pred.timeMin <= timeMax && timeMin <= pred.timeMax;
+    }
+};
+
+// the query id of a query message, which is either the id itself or a BoundedQueryMsg
+template<typename QueryMsg>
+inline const QueryMsg& queryIdOf(const QueryMsg& msg) {
+    return msg;
+}
+
+template<typename ItemIdType>
+inline const ItemIdType& queryIdOf(const BoundedQueryMsg<ItemIdType>& msg) {
+    return msg.queryId;
+}
+
+/*
+ * Attribute-filtered search: items carry an ItemAttributes record, attached
+ * at load from the attribute file, and queries an AttrPredicate read by every
+ * process from a local file. Buckets drop the items, or with their summary
+ * all items, that the predicate of a query rejects before forwarding it, and
+ * items check again before the distance. Queries without a predicate match
+ * everything.
+ * */
+template<typename ItemIdType>
+class AttributeFilter {
+public:
+    inline bool enabled() const { return !_attributePath.empty(); }
+
+    // file of "itemId tenant language time" lines, read with the items
+    void setAttributePath(const std::string& path) {
+        _attributePath = path;
+    }
+
+    inline const std::string& getAttributePath() const { return _attributePath; }
+
+    // "queryId tenant language [timeMin timeMax]" lines, -1 for any tenant or language
+    void loadQueryPredicates(const std::string& path) {
+        std::ifstream fin(path);
+        ASSERT_MSG(fin, ("cannot open " + path).c_str());
+        std::string line;
+        while (std::getline(fin, line)) {
+            std::istringstream in(line);
+            ItemIdType queryId;
+            AttrPredicate pred;
+            if (!(in >> queryId >> pred.tenant >> pred.language)) continue;
+            in >> pred.timeMin >> pred.timeMax;
+            setQueryPredicate(queryId, pred);
+        }
+    }
+
+    void setQueryPredicate(const ItemIdType& queryId, const AttrPredicate& pred) {
+        _queryPredicates[queryId] = pred;
+    }
+
+    // predicates of the broadcast queries by slot
+    template<typename QueryStoreT>
+    void build(const QueryStoreT& queries) {
+        if (!enabled()) return;
+        _predicates.assign(queries.size(), AttrPredicate());
+        for (int slot = 0; slot < queries.size(); ++slot) {
+            auto it = _queryPredicates.find(queries.getId(slot));
+            if (it != _queryPredicates.end()) _predicates[slot] = it->second;
+        }
+        // only the slots are looked up from here on
+        std::unordered_map<ItemIdType, AttrPredicate>().swap(_queryPredicates);
+    }
+
+    inline const AttrPredicate& getPredicate(int slot) const { return _predicates[slot]; }
+
+    inline bool rejects(int slot, const ItemAttributes& attrs) const {
+        return enabled() && !_predicates[slot].accepts(attrs);
+    }
+
+private:
+    std::string _attributePath;
+    std::unordered_map<ItemIdType, AttrPredicate> _queryPredicates;
+    std::vector<AttrPredicate> _predicates;
+};
+
+} // namespace losha
+} // namespace husky
@@ -0,0 +1,37 @@
+#pragma once
+#include <limits>
+
+#include "core/engine.hpp"
+
+namespace husky {
+namespace losha {
+
+/*
+ * Query message that carries the query's current k-th best distance through
+ * bucket to item, so that items abandon distances past it and do not answer
+ * with items that cannot enter the query's top-k. The bound stays at the
+ * largest float until the top-k is full.
+ * */
+template<typename ItemIdType>
+struct BoundedQueryMsg {
+    ItemIdType queryId;
+    float bound = std::numeric_limits<float>::max();
+
+    BoundedQueryMsg() {}
+    BoundedQueryMsg(const ItemIdType& id, float b) : queryId(id), bound(b) {}
+};
+
+template<typename ItemIdType>
+husky::BinStream& operator<<(husky::BinStream& stream, const BoundedQueryMsg<ItemIdType>& msg) {
+    stream << msg.queryId << msg.bound;
+    return stream;
+}
+
+template<typename ItemIdType>
+husky::BinStream& operator>>(husky::BinStream& stream, BoundedQueryMsg<ItemIdType>& msg) {
+    stream >> msg.queryId >> msg.bound;
+    return stream;
+}
+
+} // namespace losha
+} // namespace husky
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2016 Husky Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "core/engine.hpp"
+
+namespace husky {
+namespace losha {
+
+/*
+ * Fixed size key of a bucket: the signature of one table and the table index.
+ * Signatures of at most two ints (E2LSH with row <= 2, SimHash with
+ * row <= 64, PCA) are packed exactly; longer ones are hashed to 64 bits, so
+ * two signatures may share a bucket with probability ~2^-64.
+ * */
+struct BucketKey {
+    uint64_t sig = 0;
+    int table = 0;
+
+    BucketKey() {}
+    BucketKey(uint64_t s, int t) : sig(s), table(t) {}
+    BucketKey(const int* s, int length, int t) : sig(packSig(s, length)), table(t) {}
+
+    static inline uint64_t packSig(const int* s, int length) {
+        if (length == 1) return static_cast<uint32_t>(s[0]);
+        if (length == 2) {
+            return (static_cast<uint64_t>(static_cast<uint32_t>(s[0])) << 32)
+                | static_cast<uint32_t>(s[1]);
+        }
+        // FNV-1a over the ints, then a murmur finalizer
+        uint64_t h = 14695981039346656037ULL;
+        for (int i = 0; i < length; ++i) {
+            h ^= static_cast<uint32_t>(s[i]);
+            h *= 1099511628211ULL;
+        }
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    inline bool operator==(const BucketKey& other) const {
+        return sig == other.sig && table == other.table;
+    }
+    inline bool operator!=(const BucketKey& other) const {
+        return !(*this == other);
+    }
+    inline bool operator<(const BucketKey& other) const {
+        return table < other.table || (table == other.table && sig < other.sig);
+    }
+};
+
+inline husky::BinStream& operator<<(husky::BinStream& stream, const BucketKey& key) {
+    stream << key.sig << key.table;
+    return stream;
+}
+
+inline husky::BinStream& operator>>(husky::BinStream& stream, BucketKey& key) {
+    stream >> key.sig >> key.table;
+    return stream;
+}
+
+} // namespace losha
+} // namespace husky
+
+namespace std {
+template<>
+struct hash<husky::losha::BucketKey> {
+    size_t operator()(const husky::losha::BucketKey& key) const {
+        uint64_t h = key.sig ^ (static_cast<uint64_t>(key.table) * 0x9e3779b97f4a7c15ULL);
+        h ^= h >> 29;
+        return static_cast<size_t>(h);
+    }
+};
+
+inline std::string to_string(const husky::losha::BucketKey& key) {
+    return "(" + std::to_string(key.sig) + ", " + std::to_string(key.table) + ")";
+}
+}  // namespace std
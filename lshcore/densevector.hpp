@@ -17,21 +17,81 @@
 #pragma once
 #include <cmath>
 #include <string>
+#include <type_traits>
 #include <vector>
 
 #include "core/engine.hpp"
 
+#include "losha/common/span.hpp"
+#include "losha/common/sparsevector.hpp"
+#include "lshcore/itemstore.hpp"
 #include "lshcore/lshutils.hpp"
 
 namespace husky {
 namespace losha {
 
-template<typename ItemIdType, typename ItemElementType>
+template<typename T>
+husky::BinStream& operator<<(husky::BinStream& stream, const SparseVector<T>& v) {
+    stream << v._indices << v._values;
+    return stream;
+}
+
+template<typename T>
+husky::BinStream& operator>>(husky::BinStream& stream, SparseVector<T>& v) {
+    stream >> v._indices >> v._values;
+    return stream;
+}
+
+/*
+ * Where a DenseVector keeps its vector. By default it owns an ItemVector;
+ * with InStore the elements are appended to the ItemStore of the worker and
+ * only a span is held, see itemstore.hpp.
+ * */
+template<typename ItemElementType, bool InStore>
+class ItemVectorHolder {
+public:
+    inline const ItemVector<ItemElementType>& get() const { return _itemVector; }
+    inline ItemSpan<ItemElementType> span() const { return _itemVector; }
+
+    void set(ItemVector<ItemElementType>& v) {
+        _itemVector.swap(v);
+        if (_itemVector.capacity() != _itemVector.size()) {
+            _itemVector.shrink_to_fit();
+        }
+    }
+
+    void serialize(husky::BinStream& stream) const {
+        stream << _itemVector;
+    }
+
+    ItemVector<ItemElementType> _itemVector;
+};
+
+template<typename ItemElementType>
+class ItemVectorHolder<ItemElementType, true> {
+public:
+    inline const ItemSpan<ItemElementType>& get() const { return _itemSpan; }
+    inline ItemSpan<ItemElementType> span() const { return _itemSpan; }
+
+    void set(ItemVector<ItemElementType>& v) {
+        _itemSpan = ItemStore<ItemElementType>::local().append(v);
+        ItemVector<ItemElementType>().swap(v);
+    }
+
+    // same wire format as the owned vector
+    void serialize(husky::BinStream& stream) const {
+        stream << toItemVector(_itemSpan);
+    }
+
+    ItemSpan<ItemElementType> _itemSpan;
+};
+
+template<typename ItemIdType, typename ItemElementType, bool InStore = false>
 class DenseVector {
 public:
     using KeyT = ItemIdType;
     ItemIdType _itemId;
-    std::vector<ItemElementType> _itemVector;
+    ItemVectorHolder<ItemElementType, InStore> _holder;
 
     DenseVector() {}
 
@@ -40,54 +100,64 @@ public:
     // require by Husky object
     explicit DenseVector(const KeyT& id) { _itemId = id;}
 
-    DenseVector(ItemIdType& id, std::vector<ItemElementType>& v) {
+    DenseVector(ItemIdType& id, ItemVector<ItemElementType>& v) {
         _itemId = id;
-        _itemVector.swap(v);
-        if (_itemVector.capacity() != _itemVector.size()) {
-            _itemVector.shrink_to_fit();
-        }
+        _holder.set(v);
+    }
+
+    // copy from the other storage, e.g. an item in the store sent as a message
+    template<bool OtherInStore, typename = typename std::enable_if<OtherInStore != InStore>::type>
+    DenseVector(const DenseVector<ItemIdType, ItemElementType, OtherInStore>& other) {
+        _itemId = other.getItemId();
+        ItemVector<ItemElementType> v = toItemVector(other.getItemSpan());
+        _holder.set(v);
     }
 
     void setItemId(ItemIdType& id) {
         _itemId = id;
     }
 
-    void setItemVector(std::vector<ItemElementType>& itemVector) {
-        _itemVector.swap(itemVector);
-        if (_itemVector.capacity() != _itemVector.size()) {
-            _itemVector.shrink_to_fit();
-        }
+    void setItemVector(ItemVector<ItemElementType>& itemVector) {
+        _holder.set(itemVector);
+    }
+
+    // const ItemVector& when owned, the span when in the store
+    inline auto getItemVector() const -> decltype(_holder.get()) {
+        return _holder.get();
     }
 
-    const std::vector<ItemElementType>& getItemVector() const {
-        return _itemVector;
+    inline ItemSpan<ItemElementType> getItemSpan() const {
+        return _holder.span();
     }
 
     int getItemVectorSize() {
-        return _itemVector.size();
+        return getItemVector().size();
     }
 
     const ItemIdType getItemId() const {
         return _itemId;
     }
 
-    const DenseVector<ItemIdType, ItemElementType>& getItem() const {
+    const DenseVector<ItemIdType, ItemElementType, InStore>& getItem() const {
         return *this;
     }
 
     husky::BinStream& serialize(husky::BinStream& stream) const {
-        stream << _itemId << _itemVector;
+        stream << _itemId;
+        _holder.serialize(stream);
         return stream;
     }
 
     husky::BinStream& deserialize(husky::BinStream& stream) {
-        stream >> _itemId >> _itemVector;
+        ItemVector<ItemElementType> v;
+        stream >> _itemId >> v;
+        _holder.set(v);
         return stream;
     }
 
-    friend std::string to_string(const DenseVector<ItemIdType, ItemElementType>& p) {
+    friend std::string to_string(const DenseVector<ItemIdType, ItemElementType, InStore>& p) {
         std::string result = "(id: " + std::to_string(p.getItemId()) + "\titemVector: "
-            + std::to_string(p.getItemVector()) + ")\n";
+            + std::to_string(toItemVector(p.getItemSpan())) + ")\n";
         return result;
     }
 
@@ -33,7 +33,7 @@ namespace losha {
 
 template<typename ItemIdType, typename ItemElementType>
 class E2LSHFactory:
-    public LSHFactory<ItemIdType, ItemElementType> {
+    public EuclideanLSHFactory<E2LSHFactory<ItemIdType, ItemElementType>, ItemIdType, ItemElementType> {
 public:
     // hashFunctions on each worker must be the same
     std::vector<E2LSHFunction<ItemIdType, ItemElementType>> hashFunctions;   
@@ -105,7 +105,7 @@ public:
     // return all signatures, as vector<int>
     // in the format of std::vector< int >
     std::vector<int> calSignatures(
-        const vector<ItemElementType>& p) const {
+        ItemSpan<ItemElementType> p) const {
         std::vector<int> allSignatures;
         allSignatures.resize(this->hashFunctions.size());
 
@@ -116,31 +116,22 @@ public:
         return allSignatures;
     }
 
-    // return signatures of each band
-    // in the format of std::vector< std::vector<int> >
-    std::vector< std::vector<int> > calSigs (
-        // const DenseVector<ItemIdType, ItemElementType> &p) override {
-        const vector<ItemElementType> &itemVector) const override {
-        std::vector<int> allSignatures = this->calSignatures(itemVector);
-
-        std::vector< std::vector<int> > signatureInBands;
+    // one int per hash function, band after band
+    inline int getSigLength() const {
+        return this->_row;
+    }
 
-        std::vector<int> vec;
-        vec.resize(this->_row);
-        for (int i = 0; i < this->_band; ++i) {
-            int start = i * this->_row;
-            for (int j = 0; j < this->_row; ++j) {
-                vec[j] = allSignatures[start + j];
-            }
-            signatureInBands.push_back(vec);
+    void calSigsInto(
+        ItemSpan<ItemElementType> itemVector, int* out) const {
+        for (auto& fun : this->hashFunctions) {
+            *out++ = fun.getBucket(itemVector);
         }
-        return signatureInBands;
     }
 
     // return all projections
     // in the format of std::vector< float >
     std::vector<float> calProjections(
-        const vector<ItemElementType>& p) const {
+        ItemSpan<ItemElementType> p) const {
         std::vector<float> allProjections;
         allProjections.resize(this->hashFunctions.size());
 
@@ -154,7 +145,7 @@ public:
     // return projections of each band
     // in the format of std::vector< std::vector<float> >
     virtual std::vector< std::vector<float> > calProjs(
-        const vector<ItemElementType> &itemVector) const override {
+        ItemSpan<ItemElementType> itemVector) const override {
         std::vector<float> allProjections = this->calProjections(itemVector);
 
         std::vector< std::vector<float> > projectionsInBands;
@@ -171,13 +162,6 @@ public:
         return projectionsInBands;
     }
 
-    virtual float calDist(
-            const std::vector<ItemElementType> & queryVector,
-            const std::vector<ItemElementType> & itemVector) const override {
-
-        return calE2Dist(queryVector, itemVector);
-    }
-
     // for sparse vector
     // virtual float calDist(
     //        const DenseVector<ItemIdType, std::pair<int, ItemElementType> > & query,
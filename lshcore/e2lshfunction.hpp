@@ -37,18 +37,18 @@ class E2LSHFunction {
         }
 
         inline float getProjection(
-                const std::vector<ItemElementType>& itemVector) const {
+                ItemSpan<ItemElementType> itemVector) const {
             float product = dotProduct(this->a, itemVector);
             return product + this->b;
         }
 
         int getQuantization(
-                const std::vector<ItemElementType>& itemVector) const {
+                ItemSpan<ItemElementType> itemVector) const {
             return static_cast<int>(floor(this->getProjection(itemVector) / this->W));
         }
 
         int getBucket(
-                const std::vector<ItemElementType>& itemVector) const {
+                ItemSpan<ItemElementType> itemVector) const {
             return this->getQuantization(itemVector);
         }
         
@@ -60,13 +60,13 @@ class E2LSHFunction {
 
         inline float getProjection(
                 const DenseVector<ItemIdType, ItemElementType>& p) {
-            const std::vector<ItemElementType>& itemVector = p.getItemVector();
+            const ItemVector<ItemElementType>& itemVector = p.getItemVector();
             return getProjection(itemVector);
         }
 
         int getQuantization(
                 const DenseVector<ItemIdType, ItemElementType>& p) {
-            const std::vector<ItemElementType>& itemVector = p.getItemVector();
+            const ItemVector<ItemElementType>& itemVector = p.getItemVector();
             return getQuantization(itemVector);
         }
 
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2016 Husky Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <sys/mman.h>
+
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "core/engine.hpp"
+
+#include "losha/common/span.hpp"
+#include "losha/common/sparsevector.hpp"
+
+namespace husky {
+namespace losha {
+
+/*
+ * Append-only arena made of large chunks. Data never moves once appended, so
+ * spans into it stay valid for the lifetime of the arena. Chunks are mmap'ed
+ * and, with hugePages=1 in the configuration, advised to be backed by
+ * transparent huge pages.
+ * */
+template<typename T>
+class ArenaBuffer {
+public:
+    // 64MB per chunk, a multiple of the 2MB huge page size
+    static const size_t kChunkBytes = 64UL << 20;
+
+    // read once, when the first chunk is mapped
+    static bool useHugePages() {
+        static const bool enabled = husky::Context::get_param("hugePages") == "1";
+        return enabled;
+    }
+
+    ArenaBuffer() {}
+    ArenaBuffer(const ArenaBuffer&) = delete;
+    ArenaBuffer& operator=(const ArenaBuffer&) = delete;
+
+    ~ArenaBuffer() {
+        for (auto& c : _chunks) {
+            munmap(c.first, c.second);
+        }
+    }
+
+    // copy n elements into the arena
+    T* append(const T* data, size_t n) {
+        if (_used + n > _capacity) {
+            newChunk(n);
+        }
+        T* dst = _head + _used;
+        if (n != 0) memcpy(dst, data, n * sizeof(T));
+        _used += n;
+        _size += n;
+        return dst;
+    }
+
+    // number of elements stored
+    inline size_t size() const { return _size; }
+
+private:
+    void newChunk(size_t minElements) {
+        size_t bytes = kChunkBytes;
+        if (minElements * sizeof(T) > bytes) {
+            // round oversized requests up to whole chunks
+            bytes = (minElements * sizeof(T) + kChunkBytes - 1) / kChunkBytes * kChunkBytes;
+        }
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        assert(p != MAP_FAILED);
+#ifdef MADV_HUGEPAGE
+        if (useHugePages()) {
+            madvise(p, bytes, MADV_HUGEPAGE);
+        }
+#endif
+        _chunks.emplace_back(p, bytes);
+        _head = static_cast<T*>(p);
+        _used = 0;
+        _capacity = bytes / sizeof(T);
+    }
+
+    std::vector<std::pair<void*, size_t>> _chunks;
+    T* _head = nullptr;
+    size_t _used = 0;
+    size_t _capacity = 0;
+    size_t _size = 0;
+};
+
+/*
+ * Per-worker storage of item vectors. All items loaded by a worker thread are
+ * packed into its arena instead of one heap vector per object, so
+ * list_execute walks them in load order over contiguous memory.
+ * Items are never removed during a job; the arena is released with the thread.
+ * */
+template<typename ItemElementType>
+class ItemStore {
+public:
+    static ItemStore& local() {
+        static thread_local ItemStore store;
+        return store;
+    }
+
+    Span<const ItemElementType> append(const std::vector<ItemElementType>& v) {
+        return Span<const ItemElementType>(_data.append(v.data(), v.size()), v.size());
+    }
+
+    inline size_t size() const { return _data.size(); }
+
+private:
+    ArenaBuffer<ItemElementType> _data;
+};
+
+template<typename T>
+class ItemStore<std::pair<int, T>> {
+public:
+    static ItemStore& local() {
+        static thread_local ItemStore store;
+        return store;
+    }
+
+    SparseSpan<T> append(const SparseVector<T>& v) {
+        const int* indices = _indices.append(v.indices(), v.size());
+        const T* values = _values.append(v.values(), v.size());
+        return SparseSpan<T>(indices, values, v.size());
+    }
+
+    inline size_t size() const { return _values.size(); }
+
+private:
+    ArenaBuffer<int> _indices;
+    ArenaBuffer<T> _values;
+};
+
+// owning copy of a view, e.g. to send an item as a message
+template<typename T>
+std::vector<T> toItemVector(Span<const T> v) {
+    return std::vector<T>(v.begin(), v.end());
+}
+
+template<typename T>
+SparseVector<T> toItemVector(SparseSpan<T> v) {
+    SparseVector<T> result;
+    result._indices.assign(v.indices(), v.indices() + v.size());
+    result._values.assign(v.values(), v.values() + v.size());
+    return result;
+}
+
+} // namespace losha
+} // namespace husky
@@ -0,0 +1,133 @@
+#pragma once
+#include <cassert>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "boost/utility/string_ref.hpp"
+#include "losha/common/sparsevector.hpp"
+
+namespace husky {
+namespace losha {
+
+/*
+ * idsvecs: binary sparse vectors, one record per item
+ *     [int id][int nnz][int indices[nnz]][float values[nnz]]
+ * packed into fixed blocks of kIdSvecsBlockBytes so that husky's chunk input
+ * format can split the file. A record never crosses a block, the rest of a
+ * block is zero padding, read as a record with nnz = 0. Indices are ascending
+ * as in the idlibsvm input.
+ * */
+const int kIdSvecsBlockBytes = 1 << 20;
+
+inline bool isIdSvecsPath(const std::string& path) {
+    const std::string suffix = ".idsvecs";
+    return path.size() >= suffix.size()
+        && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+inline size_t idSvecsRecordBytes(size_t nnz) {
+    return 2 * sizeof(int) + nnz * (sizeof(int) + sizeof(float));
+}
+
+/*
+ * Parses the first record of a block and drops it from block, item_loader
+ * calls it again until the block is consumed. Leaves itemVector empty for
+ * the padding.
+ * */
+void parseIdSvecs(
+    boost::string_ref& block,
+    int& itemId,
+    SparseVector<float>& itemVector) {
+
+    int nnz = 0;
+    if (block.size() >= 2 * sizeof(int)) {
+        memcpy(&itemId, block.data(), sizeof(int));
+        memcpy(&nnz, block.data() + sizeof(int), sizeof(int));
+    }
+    if (nnz <= 0) {
+        block.clear();
+        return;
+    }
+    size_t bytes = idSvecsRecordBytes(nnz);
+    assert(bytes <= block.size());
+
+    const char* p = block.data() + 2 * sizeof(int);
+    itemVector._indices.resize(nnz);
+    itemVector._values.resize(nnz);
+    memcpy(itemVector._indices.data(), p, nnz * sizeof(int));
+    memcpy(itemVector._values.data(), p + nnz * sizeof(int), nnz * sizeof(float));
+    block.remove_prefix(bytes);
+}
+
+// packs records into blocks, pads and writes the last block on close()
+class IdSvecsWriter {
+public:
+    explicit IdSvecsWriter(const std::string& fileName)
+        : _fout(fileName, std::ios::binary), _block(kIdSvecsBlockBytes, 0) {}
+
+    ~IdSvecsWriter() { close(); }
+
+    bool good() const { return _fout.good(); }
+
+    // false if the record cannot fit into one block
+    bool write(int itemId, const SparseVector<float>& itemVector) {
+        int nnz = itemVector.size();
+        size_t bytes = idSvecsRecordBytes(nnz);
+        if (nnz == 0 || bytes > _block.size()) return false;
+        if (_used + bytes > _block.size()) flush();
+
+        char* p = &_block[_used];
+        memcpy(p, &itemId, sizeof(int));
+        memcpy(p + sizeof(int), &nnz, sizeof(int));
+        p += 2 * sizeof(int);
+        memcpy(p, itemVector._indices.data(), nnz * sizeof(int));
+        memcpy(p + nnz * sizeof(int), itemVector._values.data(), nnz * sizeof(float));
+        _used += bytes;
+        return true;
+    }
+
+    void close() {
+        if (!_fout.is_open()) return;
+        if (_used != 0) flush();
+        _fout.close();
+    }
+
+private:
+    void flush() {
+        std::fill(_block.begin() + _used, _block.end(), 0);
+        _fout.write(_block.data(), _block.size());
+        _used = 0;
+    }
+
+    std::ofstream _fout;
+    std::vector<char> _block;
+    size_t _used = 0;
+};
+
+// reads an idsvecs file record by record, e.g. for the ground truth tools
+class IdSvecsReader {
+public:
+    explicit IdSvecsReader(std::istream& fin)
+        : _fin(fin), _buffer(kIdSvecsBlockBytes) {}
+
+    bool next(int& itemId, SparseVector<float>& itemVector) {
+        while (true) {
+            if (_block.empty()) {
+                if (!_fin.read(_buffer.data(), _buffer.size())) return false;
+                _block = boost::string_ref(_buffer.data(), _buffer.size());
+            }
+            itemVector.clear();
+            parseIdSvecs(_block, itemId, itemVector);
+            if (itemVector.size() != 0) return true;
+        }
+    }
+
+private:
+    std::istream& _fin;
+    std::vector<char> _buffer;
+    boost::string_ref _block;
+};
+
+} // namespace losha
+} // namespace husky
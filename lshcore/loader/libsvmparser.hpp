@@ -0,0 +1,176 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "boost/tokenizer.hpp"
+#include "boost/utility/string_ref.hpp"
+#include "lshcore/lshutils.hpp"
+#include "losha/common/sparsevector.hpp"
+
+namespace husky {
+namespace losha {
+
+inline bool isLibsvmSeparator(char c) {
+    return c == ' ' || c == '\t';
+}
+
+// [p, end) is all decimal digits
+inline bool scanUnsigned(const char* p, const char* end, unsigned long long& value) {
+    if (p == end || end - p > 19) return false;
+    value = 0;
+    for (; p != end; ++p) {
+        unsigned d = static_cast<unsigned char>(*p) - '0';
+        if (d > 9) return false;
+        value = value * 10 + d;
+    }
+    return true;
+}
+
+// [p, end) is an optionally signed decimal integer
+inline bool scanInt(const char* p, const char* end, long long& value) {
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    unsigned long long magnitude;
+    if (end - p > 18 || !scanUnsigned(p, end, magnitude)) return false;
+    value = negative ? -static_cast<long long>(magnitude) : magnitude;
+    return true;
+}
+
+/*
+ * Decimal float in [p, end) without allocating. Only takes the fast path where
+ * the mantissa and the power of ten are exact floats, so that one IEEE
+ * multiply or divide rounds exactly like strtof. Returns false for anything
+ * else (long mantissas, large exponents, inf, nan, hex), callers fall back
+ * to std::stof then.
+ * */
+inline bool scanFloat(const char* p, const char* end, float& value) {
+    static const float kPow10[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    const unsigned long long kMaxMantissa = 1ULL << 24;
+
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int digits = 0;
+    for (; p != end && static_cast<unsigned>(*p - '0') <= 9; ++p, ++digits) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa > kMaxMantissa) return false;
+    }
+    if (p != end && *p == '.') {
+        for (++p; p != end && static_cast<unsigned>(*p - '0') <= 9; ++p, ++digits) {
+            mantissa = mantissa * 10 + (*p - '0');
+            if (mantissa > kMaxMantissa) return false;
+            --exponent;
+        }
+    }
+    if (digits == 0) return false;
+
+    if (p != end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        long long e;
+        if (!scanInt(p, end, e) || e > 100 || e < -100) return false;
+        exponent += e;
+        p = end;
+    }
+    if (p != end || exponent > 10 || exponent < -10) return false;
+
+    value = static_cast<float>(mantissa);
+    if (exponent >= 0) {
+        value *= kPow10[exponent];
+    } else {
+        value /= kPow10[-exponent];
+    }
+    if (negative) value = -value;
+    return true;
+}
+
+// the tokenizer based parser, kept as the reference for parseIdLibsvm
+void parseIdLibsvmTokenized(
+    boost::string_ref& line,
+    int& itemId,
+    SparseVector<float>& itemVector) {
+
+    assert(line.size() != 0);
+
+    boost::char_separator<char> sep(" \t");
+    boost::tokenizer<boost::char_separator<char>> tok(line, sep);
+
+    bool setId = false;
+    for(auto &w : tok) {
+        if(!setId) {
+            itemId = std::stoi(w);
+            setId = true;
+        } else {
+            auto p = husky::losha::lshStoPair(w);
+            itemVector.push_back(p.first, p.second);
+        }
+    }
+    // kernels rely on ascending feature indices
+    itemVector.sortByIndex();
+    assert (itemVector.size() != 0);
+}
+
+/*
+ * One pass over the line without building strings: "id index:value ...".
+ * Capacity is reserved from the number of ':' first. Tokens outside the fast
+ * scanners' range go through the same std::stoi/lshStoPair as before, so the
+ * result equals parseIdLibsvmTokenized.
+ * */
+void parseIdLibsvm(
+    boost::string_ref& line,
+    int& itemId,
+    SparseVector<float>& itemVector) {
+
+    assert(line.size() != 0);
+
+    const char* p = line.data();
+    const char* end = p + line.size();
+    itemVector.reserve(itemVector.size() + std::count(p, end, ':'));
+
+    bool setId = false;
+    while (true) {
+        while (p != end && isLibsvmSeparator(*p)) ++p;
+        if (p == end) break;
+        const char* tokenEnd = p;
+        while (tokenEnd != end && !isLibsvmSeparator(*tokenEnd)) ++tokenEnd;
+
+        if (!setId) {
+            long long id;
+            if (scanInt(p, tokenEnd, id) && id >= INT_MIN && id <= INT_MAX) {
+                itemId = id;
+            } else {
+                itemId = std::stoi(std::string(p, tokenEnd));
+            }
+            setId = true;
+        } else {
+            const char* colon = std::find(p, tokenEnd, ':');
+            unsigned long long index;
+            float value;
+            if (colon != tokenEnd
+                    && scanUnsigned(p, colon, index) && index <= UINT_MAX
+                    && scanFloat(colon + 1, tokenEnd, value)) {
+                itemVector.push_back(static_cast<unsigned>(index), value);
+            } else {
+                auto pair = lshStoPair(std::string(p, tokenEnd));
+                itemVector.push_back(pair.first, pair.second);
+            }
+        }
+        p = tokenEnd;
+    }
+    // kernels rely on ascending feature indices
+    itemVector.sortByIndex();
+    assert (itemVector.size() != 0);
+}
+
+} // namespace losha
+} // namespace husky
@@ -4,6 +4,10 @@
 #include "boost/tokenizer.hpp"
 #include "lshcore/lshutils.cpp"
 #include "lshcore/densevector.hpp"
+#include "lshcore/loader/idsvecs.hpp"
+#include "lshcore/loader/libsvmparser.hpp"
+#include "lshcore/loader/mmapinputformat.hpp"
+#include "losha/common/sparsevector.hpp"
 using std::vector;
 using std::string;
 
@@ -24,55 +28,63 @@ void parseIdFvecs(
     int dimension = -1;
     memcpy(&dimension, &line[4], 4);
 
-    // load fvecs
+    // load fvecs in one copy
     itemVector.resize(dimension);
-    int startIdx = 8;
-    for (int i = 0; i < dimension; ++i) {
-        memcpy(&itemVector[i], &line[startIdx], sizeof(ItemElementType));
-        startIdx += sizeof(ItemElementType);
-    } 
+    memcpy(itemVector.data(), &line[8], dimension * sizeof(ItemElementType));
 }
 
-template<typename ObjType, typename ItemIdType, typename ItemElementType>
-auto item_loader(
-    husky::PushChannel< vector<ItemElementType>, ObjType> &ch,
-    void (*setItem)(boost::string_ref&, ItemIdType&, vector<ItemElementType>&)) {
-
-    auto parse_lambda = [&ch, &setItem]
-    (boost::string_ref & line) {
-        try {
-            ItemIdType itemId;
-            vector<ItemElementType> itemVector;
-            setItem(line, itemId, itemVector);
+// Calls setItem on every record of a chunk. Parsers of one record per chunk
+// leave line untouched; parsers of packed records (parseIdSvecs) drop the
+// record they read from line and leave itemVector empty for padding.
+template<typename ItemIdType, typename ItemVectorType, typename Handler>
+void forEachRecord(
+    boost::string_ref& line,
+    void (*setItem)(boost::string_ref&, ItemIdType&, ItemVectorType&),
+    Handler handler) {
 
-            ch.push(itemVector, itemId);
-        } catch(std::exception e) {
-            assert("bucket_parser error");
+    while (true) {
+        size_t remaining = line.size();
+        ItemIdType itemId;
+        ItemVectorType itemVector;
+        setItem(line, itemId, itemVector);
+        if (itemVector.size() != 0) {
+            handler(itemId, itemVector);
         }
-    };
-    return parse_lambda;
+        if (line.empty() || line.size() == remaining) break;
+    }
 }
 
-
-void parseIdLibsvm(
+// idbvecs: [int id][int dimension][uint8 features], e.g. SIFT1B
+void parseIdBvecs(
     boost::string_ref& line,
     int& itemId,
-    std::vector<std::pair<int, float> >& itemVector) {
+    std::vector<uint8_t>& itemVector) {
+    parseIdFvecs(line, itemId, itemVector);
+}
 
-    assert(line.size() != 0);
+inline bool isBvecsPath(const std::string& path) {
+    const std::string suffix = "bvecs";
+    return path.size() >= suffix.size()
+        && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
 
-    boost::char_separator<char> sep(" \t");
-    boost::tokenizer<boost::char_separator<char>> tok(line, sep);
+template<typename ObjType, typename ItemIdType, typename ItemVectorType>
+auto item_loader(
+    husky::PushChannel<ItemVectorType, ObjType> &ch,
+    void (*setItem)(boost::string_ref&, ItemIdType&, ItemVectorType&)) {
 
-    //optimize to use dimension to avoid push back set lshStof
-    bool setId = false;
-    for(auto &w : tok) {
-        if(!setId) {
-            itemId = std::stoi(w);
-            setId = true;
-        } else itemVector.push_back(husky::losha::lshStoPair(w));
-    }
-    assert (itemVector.size() != 0);
+    auto parse_lambda = [&ch, setItem]
+    (boost::string_ref & line) {
+        try {
+            forEachRecord(line, setItem,
+                [&ch](ItemIdType& itemId, ItemVectorType& itemVector) {
+                    ch.push(itemVector, itemId);
+                });
+        } catch(std::exception e) {
+            assert("bucket_parser error");
+        }
+    };
+    return parse_lambda;
 }
 }
 }
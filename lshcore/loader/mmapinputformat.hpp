@@ -0,0 +1,127 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "base/log.hpp"
+#include "boost/utility/string_ref.hpp"
+#include "core/engine.hpp"
+#include "io/input/inputformat_base.hpp"
+
+namespace husky {
+namespace losha {
+
+/*
+ * Input format over a local file of fixed-size records, for single-node and
+ * test deployments without HDFS. The file is mmap'ed and worker i of n reads
+ * the i-th contiguous range of records. Records are views into the mapping.
+ *
+ * Paths look like file:///data/sift_base.idfvecs. idfvecs/idbvecs records are
+ * handed out as they are; fvecs/bvecs records have no id, so they are copied
+ * behind their record index to look like idfvecs/idbvecs records.
+ * */
+class MmapInputFormat : public husky::io::InputFormatBase {
+public:
+    typedef boost::string_ref RecordT;
+
+    static bool isLocalPath(const std::string& path) {
+        return path.compare(0, strlen(kScheme), kScheme) == 0;
+    }
+
+    // idRecordBytes: size of an idfvecs/idbvecs record, i.e. 8 + dimension * sizeof(element)
+    explicit MmapInputFormat(int idRecordBytes) : _idRecordBytes(idRecordBytes) {}
+    MmapInputFormat(const MmapInputFormat&) = delete;
+    MmapInputFormat& operator=(const MmapInputFormat&) = delete;
+
+    ~MmapInputFormat() { unmap(); }
+
+    // this worker's share of the records
+    void set_input(const std::string& path) {
+        set_input(path, husky::Context::get_global_tid(), husky::Context::get_num_workers());
+    }
+
+    void set_input(const std::string& path, int part, int numParts) {
+        unmap();
+        std::string fileName = isLocalPath(path) ? path.substr(strlen(kScheme)) : path;
+        _withId = !hasSuffix(fileName, ".fvecs") && !hasSuffix(fileName, ".bvecs");
+        _recordBytes = _withId ? _idRecordBytes : _idRecordBytes - sizeof(int);
+
+        int fd = open(fileName.c_str(), O_RDONLY);
+        ASSERT_MSG(fd != -1, ("cannot open " + fileName).c_str());
+        struct stat st;
+        fstat(fd, &st);
+        _bytes = st.st_size;
+        ASSERT_MSG(_bytes % _recordBytes == 0, "file size is not a multiple of the record size");
+        if (_bytes != 0) {
+            void* p = mmap(nullptr, _bytes, PROT_READ, MAP_SHARED, fd, 0);
+            ASSERT_MSG(p != MAP_FAILED, ("cannot mmap " + fileName).c_str());
+            _data = static_cast<const char*>(p);
+        }
+        close(fd);
+
+        size_t numRecords = _bytes / _recordBytes;
+        _next = numRecords * part / numParts;
+        _end = numRecords * (part + 1) / numParts;
+        if (_data != nullptr && _end > _next) {
+            madvise(const_cast<char*>(_data) + _next * _recordBytes,
+                (_end - _next) * _recordBytes, MADV_SEQUENTIAL);
+        }
+        if (!_withId) {
+            _scratch.resize(_idRecordBytes);
+        }
+        _setup = true;
+    }
+
+    virtual int is_setup() const { return _setup; }
+
+    virtual bool next(RecordT& record) {
+        if (_next >= _end) return false;
+        const char* p = _data + _next * _recordBytes;
+        if (_withId) {
+            record = RecordT(p, _recordBytes);
+        } else {
+            int itemId = _next;
+            memcpy(&_scratch[0], &itemId, sizeof(int));
+            memcpy(&_scratch[sizeof(int)], p, _recordBytes);
+            record = RecordT(_scratch.data(), _scratch.size());
+        }
+        ++_next;
+        return true;
+    }
+
+    static RecordT& recast(RecordT& record) { return record; }
+
+private:
+    static bool hasSuffix(const std::string& s, const std::string& suffix) {
+        return s.size() >= suffix.size()
+            && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+
+    void unmap() {
+        if (_data != nullptr) {
+            munmap(const_cast<char*>(_data), _bytes);
+            _data = nullptr;
+        }
+        _setup = false;
+    }
+
+    static constexpr const char* kScheme = "file://";
+
+    size_t _idRecordBytes;
+    size_t _recordBytes = 0;
+    bool _withId = true;
+    bool _setup = false;
+    const char* _data = nullptr;
+    size_t _bytes = 0;
+    size_t _next = 0;
+    size_t _end = 0;
+    std::vector<char> _scratch;
+};
+
+} // namespace losha
+} // namespace husky
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2016 Husky Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <unordered_map>
+#include <vector>
+
+#include "core/engine.hpp"
+
+namespace husky {
+namespace losha {
+
+/*
+ * Items can be kept on the worker that read them (loadMode=local) instead of
+ * being shuffled to the hash owner of their id. husky delivers a message to
+ * the hash owner of its key, so every worker derives the same route key for
+ * each worker: the smallest int key the hash ring assigns to it. Buckets
+ * record the route key of each item next to its id.
+ * */
+class ItemRoutes {
+public:
+    // route keys indexed by global worker id
+    static const std::vector<int>& routeKeys() {
+        static const std::vector<int> keys = buildRouteKeys();
+        return keys;
+    }
+
+    static int localRouteKey() {
+        return routeKeys()[husky::Context::get_global_tid()];
+    }
+
+private:
+    static std::vector<int> buildRouteKeys() {
+        int numWorkers = husky::Context::get_num_workers();
+        std::vector<int> keys(numWorkers, -1);
+        int found = 0;
+        for (int key = 0; found < numWorkers; ++key) {
+            int tid = husky::Context::get_hashring().hash_lookup(key);
+            if (keys[tid] == -1) {
+                keys[tid] = key;
+                ++found;
+            }
+        }
+        return keys;
+    }
+};
+
+/*
+ * One object per worker, keyed by its route key. Buckets push
+ * (query message, item id) to the inbox of the item's worker, which sorts
+ * them by item id for the local items to pick up.
+ * */
+template<typename ItemIdType, typename QueryMsg>
+class ItemInbox {
+public:
+    using KeyT = int;
+    KeyT routeKey_;
+
+    explicit ItemInbox(const KeyT& routeKey): routeKey_(routeKey) {}
+    const KeyT& id() const { return routeKey_;}
+
+    static void deliver(const std::vector<std::pair<QueryMsg, ItemIdType>>& msgs) {
+        for (const auto& p : msgs) {
+            local_msgs[p.second].push_back(p.first);
+        }
+    }
+
+    static const std::vector<QueryMsg>& getMsgs(const ItemIdType& itemId) {
+        static const std::vector<QueryMsg> empty;
+        auto it = local_msgs.find(itemId);
+        return it == local_msgs.end() ? empty : it->second;
+    }
+
+    // keeps the per-item buffers for the next iteration
+    static void clear() {
+        for (auto& p : local_msgs) {
+            p.second.clear();
+        }
+    }
+
+private:
+    static thread_local std::unordered_map<ItemIdType, std::vector<QueryMsg>> local_msgs;
+};
+
+template<typename ItemIdType, typename QueryMsg>
+thread_local std::unordered_map<ItemIdType, std::vector<QueryMsg>>
+    ItemInbox<ItemIdType, QueryMsg>::local_msgs;
+
+} // namespace losha
+} // namespace husky
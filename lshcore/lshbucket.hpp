@@ -15,10 +15,12 @@
  */
 
 #pragma once
+#include <cstdint>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include "bucketkey.hpp"
 #include "densevector.hpp"
 #include "lshfactory.hpp"
 #include "lshutils.hpp"
@@ -26,14 +28,39 @@
 namespace husky {
 namespace losha { 
 
+// what a bucket keeps of an item next to its id, sent with the load message
+// when attribute filters or the sketch prefilter are enabled
+struct ItemFilterFields {
+    ItemAttributes attrs;
+    uint64_t sketch = 0;
+};
+
+inline husky::BinStream& operator<<(husky::BinStream& stream, const ItemFilterFields& fields) {
+    stream << fields.attrs << fields.sketch;
+    return stream;
+}
+
+inline husky::BinStream& operator>>(husky::BinStream& stream, ItemFilterFields& fields) {
+    stream >> fields.attrs >> fields.sketch;
+    return stream;
+}
+
 template<typename ItemIdType, typename ItemElementType,
     typename QueryMsg,
-    typename AnswerMsg = std::pair<ItemIdType, float> >
+    typename AnswerMsg = std::pair<ItemIdType, float>,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
 class LSHBucket {
     public:
-        using KeyT = std::vector<int>;
-        KeyT bucketId_; // (sig, table), the last integer represents table, starting from 0
+        using KeyT = BucketKey;
+        KeyT bucketId_; // (sig, table), table starting from 0
         std::vector<ItemIdType> itemIds_;
+        // route keys of itemIds_, only filled when items stay where they were read
+        std::vector<int> itemRoutes_;
+        // attributes of itemIds_ and their summary, only filled for filtered search
+        std::vector<ItemAttributes> itemAttrs_;
+        AttrSummary attrSummary_;
+        // SimHash sketches of itemIds_, only filled with the sketch prefilter
+        std::vector<uint64_t> itemSketches_;
 
         explicit LSHBucket(const typename LSHBucket::KeyT& bId): bucketId_(bId) {}
         const KeyT& id() const { return bucketId_;}
@@ -45,7 +72,7 @@ class LSHBucket {
         // }
 
         // explicit LSHBucket(const typename LSHBucket::KeyT& id): bucketId_(id) {}
-        virtual void forward(LSHFactory<ItemIdType, ItemElementType>& factory) {
+        virtual void forward(FactoryType& factory) {
         }
 
         unsigned getNumItems() {
@@ -53,10 +80,10 @@ class LSHBucket {
         }
         
         unsigned getTable() {
-            return bucketId_.back();
+            return bucketId_.table;
         }
 
-        const vector<int> getId() {
+        const KeyT& getId() {
             return this->bucketId_;
         }
         // std::string toString() {
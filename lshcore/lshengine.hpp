@@ -13,7 +13,12 @@
  */
 
 #pragma once
+#include <fstream>
+#include <limits>
+#include <sstream>
 #include <string>
+#include <type_traits>
+#include <unordered_set>
 #include <vector>
 #include <functional>
 #include "base/serialization.hpp"
@@ -22,15 +27,20 @@
 #include "boost/functional/hash.hpp"
 #include "core/combiner.hpp"
 #include "core/engine.hpp"
+#include "io/input/inputformat_store.hpp"
 #include "io/input/line_inputformat.hpp"
 #include "lib/aggregator_factory.hpp"
 
 #include "lshbucket.hpp"
 #include "lshitem.hpp"
+#include "localitems.hpp"
 #include "lshquery.hpp"
 #include "lshstat.hpp"
+#include "probebudget.hpp"
 #include "lshcore/loader/loader.h"
 #include "losha/common/aggre.hpp"
+#include "losha/common/sparsekernel.hpp"
+#include "losha/common/writer.hpp"
 
 
 using std::vector;
@@ -50,54 +60,304 @@ public:
 namespace husky {
 namespace losha {
 
+/*
+ * Radius mode from the configuration: distanceThreshold (default defaultRadius),
+ * sketchFilter=1 for the SimHash prefilter of angular factories,
+ * sketchConfidence and an optional local queryRadiusPath of
+ * "queryId radius" lines. Call once on the factory before the items
+ * are loaded, which send their sketches to the buckets.
+ * */
+template<typename FactoryType>
+void configureRadiusMode(FactoryType& factory, float defaultRadius) {
+    std::string radius = husky::Context::get_param("distanceThreshold");
+    std::string sketchFilter = husky::Context::get_param("sketchFilter");
+    std::string confidence = husky::Context::get_param("sketchConfidence");
+    auto& filter = factory.getRadiusFilter();
+    filter.initialize(
+        radius.empty() ? defaultRadius : std::stof(radius),
+        sketchFilter == "1",
+        // sparse sketches need no projection matrix
+        std::is_arithmetic<typename FactoryType::ElementT>::value ? factory._dimension : 0,
+        confidence.empty() ? 3 : std::stof(confidence));
+
+    std::string queryRadiusPath = husky::Context::get_param("queryRadiusPath");
+    if (queryRadiusPath.empty()) return;
+    std::ifstream fin(queryRadiusPath);
+    ASSERT_MSG(fin, ("cannot open " + queryRadiusPath).c_str());
+    typename FactoryType::IdT queryId;
+    float queryRadius;
+    while (fin >> queryId >> queryRadius) {
+        filter.setQueryRadius(queryId, queryRadius);
+    }
+}
+
+/*
+ * Re-ranking from the configuration: rerankTopR > 0 enables it, the product
+ * quantizer is trained on the local file pqTrainPath (idfvecs or idbvecs,
+ * for example written by knngraph/tools/sample_base) with pqSubspaces
+ * subspaces and pqIterations k-means iterations. Every worker trains the
+ * same codebooks from the same file. Call once on the factory before the
+ * items are loaded.
+ * */
+template<typename FactoryType>
+void configureRerank(FactoryType& factory) {
+    std::string topR = husky::Context::get_param("rerankTopR");
+    if (topR.empty() || std::stoi(topR) <= 0) return;
+    std::string trainPath = husky::Context::get_param("pqTrainPath");
+    ASSERT_MSG(!trainPath.empty(), "rerankTopR needs pqTrainPath");
+    std::string subspaces = husky::Context::get_param("pqSubspaces");
+    std::string iterations = husky::Context::get_param("pqIterations");
+
+    // [int id][int dimension][dimension floats or bytes] records
+    bool bytes = trainPath.size() >= 8 && trainPath.compare(trainPath.size() - 8, 8, ".idbvecs") == 0;
+    std::ifstream fin(trainPath, std::ios::binary);
+    ASSERT_MSG(fin, ("cannot open " + trainPath).c_str());
+    std::vector<float> samples;
+    std::vector<uint8_t> byteRecord;
+    int header[2];
+    int dimension = 0;
+    while (fin.read(reinterpret_cast<char*>(header), sizeof(header))) {
+        ASSERT_MSG(dimension == 0 || header[1] == dimension, "PQ training vectors must have the same dimension");
+        dimension = header[1];
+        size_t offset = samples.size();
+        samples.resize(offset + dimension);
+        if (bytes) {
+            byteRecord.resize(dimension);
+            fin.read(reinterpret_cast<char*>(byteRecord.data()), dimension);
+            std::copy(byteRecord.begin(), byteRecord.end(), samples.begin() + offset);
+        } else {
+            fin.read(reinterpret_cast<char*>(&samples[offset]), dimension * sizeof(float));
+        }
+    }
+
+    auto& reranker = factory.getReranker();
+    reranker.initialize(std::stoi(topR));
+    reranker.getQuantizer().train(samples, dimension,
+        subspaces.empty() ? 8 : std::stoi(subspaces),
+        iterations.empty() ? 10 : std::stoi(iterations));
+}
+
+/*
+ * Attribute-filtered search from the configuration: attributePath is a file
+ * of "itemId tenant language time" lines, read like the items and split over
+ * the workers, queryFilterPath a local one of
+ * "queryId tenant language [timeMin timeMax]" lines with -1 for any tenant or
+ * language. Call once on the factory before the items are loaded.
+ * */
+template<typename FactoryType>
+void configureAttributes(FactoryType& factory) {
+    std::string attributePath = husky::Context::get_param("attributePath");
+    if (attributePath.empty()) return;
+    auto& filter = factory.getAttributeFilter();
+    filter.setAttributePath(attributePath);
+    std::string queryFilterPath = husky::Context::get_param("queryFilterPath");
+    if (!queryFilterPath.empty()) {
+        filter.loadQueryPredicates(queryFilterPath);
+    }
+}
+
+// summary of the attributes of the items of a bucket, once they are set
+template<typename BucketType>
+void summarizeBucket(BucketType& bucket) {
+    for (const auto& attrs : bucket.itemAttrs_) {
+        bucket.attrSummary_.add(attrs);
+    }
+}
+
+/*
+ * Attaches their attribute records to the loaded items. Every item has asked
+ * the AttrRecord of its id beforehand through askCH, with its route key or -1
+ * if it lives on the hash owner of its id. The attribute file is read like the
+ * items, each record going to the AttrRecord of its item, which answers the
+ * items that asked. fn(item) runs on every item once its attributes are set;
+ * items without a record get the default one.
+ * */
+template<typename ItemType, typename FactoryType, typename AskChannel, typename FnT>
+void attachAttributes(
+    FactoryType& factory,
+    husky::ObjList<AttrRecord<typename FactoryType::IdT>>& record_list,
+    husky::ObjList<ItemType>& item_list,
+    AskChannel& askCH,
+    bool localItems,
+    FnT fn) {
+
+    typedef typename FactoryType::IdT ItemIdType;
+    typedef ItemInbox<ItemIdType, ItemAttributes> AttrInbox;
+
+    auto& attrInfmt = husky::io::InputFormatStore::create_line_inputformat();
+    attrInfmt.set_input(factory.getAttributeFilter().getAttributePath());
+    auto& recordCH =
+        husky::ChannelStore::create_push_channel<ItemAttributes>(attrInfmt, record_list);
+    auto& replyCH =
+        husky::ChannelStore::create_push_channel<ItemAttributes>(record_list, item_list);
+    auto& inbox_list = husky::ObjListStore::create_objlist<AttrInbox>();
+    auto& replyInboxCH =
+        husky::ChannelStore::create_push_channel<
+            std::pair<ItemAttributes, ItemIdType>>(record_list, inbox_list);
+
+    husky::load(attrInfmt, [&recordCH](boost::string_ref& line) {
+        std::istringstream in(line.to_string());
+        ItemIdType itemId;
+        ItemAttributes attrs;
+        if (in >> itemId >> attrs.tenant >> attrs.language >> attrs.time) {
+            recordCH.push(attrs, itemId);
+        }
+    });
+
+    husky::list_execute(record_list,
+        {&recordCH, &askCH}, {&replyCH, &replyInboxCH},
+        [&recordCH, &askCH, &replyCH, &replyInboxCH](AttrRecord<ItemIdType>& record) {
+            const auto& records = recordCH.get(record);
+            ItemAttributes attrs = records.empty() ? ItemAttributes() : records.back();
+            for (int routeKey : askCH.get(record)) {
+                if (routeKey == -1) {
+                    replyCH.push(attrs, record.id());
+                } else {
+                    replyInboxCH.push(std::make_pair(attrs, record.id()), routeKey);
+                }
+            }
+    });
+    if (localItems) {
+        husky::list_execute(inbox_list,
+            {&replyInboxCH}, {},
+            [&replyInboxCH](AttrInbox& inbox) {
+                AttrInbox::deliver(replyInboxCH.get(inbox));
+        });
+    }
+
+    husky::list_execute(item_list,
+        {&replyCH}, {},
+        [&replyCH, &fn, localItems](ItemType& item) {
+            const vector<ItemAttributes>& attrs = localItems
+                ? AttrInbox::getMsgs(item.getItemId())
+                : replyCH.get(item);
+            item.setAttributes(attrs.empty() ? ItemAttributes() : attrs.back());
+            fn(item);
+    });
+    if (localItems) {
+        AttrInbox::clear();
+    }
+}
+
+// pushes msg to the bucket of the item in every table
+template<typename FactoryType, typename ItemType, typename ChannelType, typename MsgT>
+void pushToBuckets(const FactoryType& factory, const ItemType& item, ChannelType& ch, const MsgT& msg) {
+    // calculate buckets into the per-thread scratch
+    static thread_local vector<BucketKey> myBuckets;
+    myBuckets.resize(factory.getNumTables());
+    factory.calBucketsInto(item.getItemSpan(), myBuckets.data());
+    for (const auto& bId : myBuckets) {
+        ch.push(msg, bId);
+    }
+}
+
+// what the buckets keep of an item next to its id, once its attributes are set
+template<typename FactoryType, typename ItemType>
+ItemFilterFields filterFieldsOf(const FactoryType& factory, const ItemType& item) {
+    ItemFilterFields fields;
+    fields.attrs = item.getAttributes();
+    if (factory.getRadiusFilter().sketchEnabled()) {
+        fields.sketch = factory.getRadiusFilter().sketch(item.getItemSpan());
+    }
+    return fields;
+}
+
+// the fields of the enabled filters of the items in msgs, addId(msg.first) adds the item
+template<typename FactoryType, typename BucketType, typename MsgT, typename FnT>
+void addFilteredItems(const FactoryType& factory, BucketType& bucket, const std::vector<MsgT>& msgs, FnT addId) {
+    bool withAttrs = factory.getAttributeFilter().enabled();
+    bool withSketches = factory.getRadiusFilter().sketchEnabled();
+    for (const auto& msg : msgs) {
+        addId(msg.first);
+        if (withAttrs) bucket.itemAttrs_.push_back(msg.second.attrs);
+        if (withSketches) bucket.itemSketches_.push_back(msg.second.sketch);
+    }
+}
+
+// per item state of the optional stages, once its vector is set
+template<typename FactoryType, typename ItemType>
+void prepareItem(const FactoryType& factory, ItemType& item) {
+    if (factory.getReranker().enabled()) {
+        const auto& pq = factory.getReranker().getQuantizer();
+        static thread_local std::vector<uint8_t> code;
+        code.resize(pq.getNumSubspaces());
+        pq.encode(item.getItemSpan(), code.data());
+        item.setPQCode(ItemStore<uint8_t>::local().append(code));
+    }
+}
+
 // assume input is set for InputFormat
+// FactoryType is the concrete factory, so that bucket and distance
+// computations are resolved at compile time
 template<typename BucketType, typename ItemType,
-    typename ItemIdType, typename ItemElementType, typename InputFormat>
+    typename FactoryType, typename InputFormat>
 void loadItems(
-    LSHFactory<ItemIdType, ItemElementType>& factory,
+    FactoryType& factory,
     husky::ObjList<BucketType>& bucket_list,
     husky::ObjList<ItemType>& item_list,
-    void (*setItem)(boost::string_ref&, ItemIdType&, vector<ItemElementType>&),
+    void (*setItem)(boost::string_ref&, typename FactoryType::IdT&, typename FactoryType::VectorT&),
     InputFormat& infmt) {
 
     if (husky::Context::get_global_tid() == 0)
         husky::LOG_I << "(in loadItems) start: load items" << std::endl;
 
+    typedef typename FactoryType::IdT ItemIdType;
+    bool withAttrs = factory.getAttributeFilter().enabled();
+    bool withFields = withAttrs || factory.getRadiusFilter().sketchEnabled();
+
     auto& loadItemCH = 
         husky::ChannelStore::create_push_channel<
-            vector<ItemElementType>>(infmt, item_list);
+            typename FactoryType::VectorT>(infmt, item_list);
 
     auto& loadBucketCH = 
-        husky::ChannelStore::create_push_channel<int>(item_list, bucket_list);
+        husky::ChannelStore::create_push_channel<ItemIdType>(item_list, bucket_list);
+    // with attribute filters or sketches, items go to their buckets with their fields
+    auto& record_list = husky::ObjListStore::create_objlist<AttrRecord<ItemIdType>>();
+    auto& askAttrCH =
+        husky::ChannelStore::create_push_channel<int>(item_list, record_list);
+    auto& loadBucketFieldsCH =
+        husky::ChannelStore::create_push_channel<
+            std::pair<ItemIdType, ItemFilterFields>>(item_list, bucket_list);
 
     husky::load(infmt, 
         item_loader(loadItemCH, setItem));
 
     // create item object, need list execute to active the object creation
     husky::list_execute(item_list, 
-        [&factory, &loadItemCH, &loadBucketCH](ItemType& item) {
+        [&factory, &loadItemCH, &loadBucketCH, &askAttrCH, &loadBucketFieldsCH, withAttrs, withFields](ItemType& item) {
             auto msgs = loadItemCH.get(item);
             assert(msgs.size() == 1);
 
             item.setItemVector(msgs[0]);
             assert(item.getItemVector().size() != 0);
-            // calculate buckets
-            vector< vector<int> > myBuckets 
-                = factory.calItemBuckets(item);
-
-            // send message to create bucket object
-            vector< vector<int> >::iterator it;
-            for (it = myBuckets.begin(); it != myBuckets.end(); ++it) {
-                loadBucketCH.push(item.getItemId(), *it);
+            prepareItem(factory, item);
+            // send message to create bucket object, or wait for the attributes
+            if (withAttrs) {
+                askAttrCH.push(-1, item.getItemId());
+            } else if (withFields) {
+                pushToBuckets(factory, item, loadBucketFieldsCH,
+                    std::make_pair(item.getItemId(), filterFieldsOf(factory, item)));
+            } else {
+                pushToBuckets(factory, item, loadBucketCH, item.getItemId());
             }
         }
     );
+    if (withAttrs) {
+        attachAttributes(factory, record_list, item_list, askAttrCH, false,
+            [&factory, &loadBucketFieldsCH](ItemType& item) {
+                pushToBuckets(factory, item, loadBucketFieldsCH,
+                    std::make_pair(item.getItemId(), filterFieldsOf(factory, item)));
+        });
+    }
 
     husky::list_execute(bucket_list,
-        [&loadBucketCH](BucketType& bucket) {
+        [&factory, &loadBucketCH, &loadBucketFieldsCH](BucketType& bucket) {
             auto& msgs = loadBucketCH.get(bucket);
             bucket.itemIds_ = msgs;
+            addFilteredItems(factory, bucket, loadBucketFieldsCH.get(bucket),
+                [&bucket](const ItemIdType& itemId) { bucket.itemIds_.push_back(itemId); });
             bucket.itemIds_.shrink_to_fit();
+            summarizeBucket(bucket);
     });
 
     if (husky::Context::get_global_tid() == 0) 
@@ -109,12 +369,94 @@ void loadItems(
     return;
 }
 
+// like loadItems, but every item stays on the worker that read it and only
+// (item id, route key) pairs are shuffled to the bucket owners
+template<typename BucketType, typename ItemType,
+    typename FactoryType, typename InputFormat>
+void loadLocalItems(
+    FactoryType& factory,
+    husky::ObjList<BucketType>& bucket_list,
+    husky::ObjList<ItemType>& item_list,
+    void (*setItem)(boost::string_ref&, typename FactoryType::IdT&, typename FactoryType::VectorT&),
+    InputFormat& infmt) {
+
+    typedef typename FactoryType::IdT ItemIdType;
+
+    if (husky::Context::get_global_tid() == 0)
+        husky::LOG_I << "(in loadLocalItems) start: load items" << std::endl;
+
+    typedef std::pair<ItemIdType, int> RoutedId;
+    bool withAttrs = factory.getAttributeFilter().enabled();
+    bool withFields = withAttrs || factory.getRadiusFilter().sketchEnabled();
+
+    auto& loadBucketCH =
+        husky::ChannelStore::create_push_channel<RoutedId>(infmt, bucket_list);
+    // with attribute filters or sketches, items go to their buckets with their fields
+    auto& record_list = husky::ObjListStore::create_objlist<AttrRecord<ItemIdType>>();
+    auto& askAttrCH =
+        husky::ChannelStore::create_push_channel<int>(infmt, record_list);
+    auto& loadBucketFieldsCH =
+        husky::ChannelStore::create_push_channel<
+            std::pair<RoutedId, ItemFilterFields>>(item_list, bucket_list);
+
+    int routeKey = ItemRoutes::localRouteKey();
+    husky::load(infmt,
+        [&factory, &item_list, &loadBucketCH, &askAttrCH, &loadBucketFieldsCH, setItem, routeKey, withAttrs, withFields](boost::string_ref& line) {
+            forEachRecord(line, setItem,
+                [&](ItemIdType& itemId, typename FactoryType::VectorT& itemVector) {
+                    ItemType item(itemId);
+                    item.setItemVector(itemVector);
+                    prepareItem(factory, item);
+
+                    if (withAttrs) {
+                        askAttrCH.push(routeKey, itemId);
+                    } else if (withFields) {
+                        pushToBuckets(factory, item, loadBucketFieldsCH,
+                            std::make_pair(RoutedId(itemId, routeKey), filterFieldsOf(factory, item)));
+                    } else {
+                        pushToBuckets(factory, item, loadBucketCH, RoutedId(itemId, routeKey));
+                    }
+                    item_list.add_object(std::move(item));
+                });
+        }
+    );
+    if (withAttrs) {
+        attachAttributes(factory, record_list, item_list, askAttrCH, true,
+            [&factory, &loadBucketFieldsCH, routeKey](ItemType& item) {
+                pushToBuckets(factory, item, loadBucketFieldsCH,
+                    std::make_pair(RoutedId(item.getItemId(), routeKey), filterFieldsOf(factory, item)));
+        });
+    }
+
+    husky::list_execute(bucket_list,
+        [&factory, &loadBucketCH, &loadBucketFieldsCH](BucketType& bucket) {
+            auto& msgs = loadBucketCH.get(bucket);
+            bucket.itemIds_.resize(msgs.size());
+            bucket.itemRoutes_.resize(msgs.size());
+            for (size_t i = 0; i < msgs.size(); ++i) {
+                bucket.itemIds_[i] = msgs[i].first;
+                bucket.itemRoutes_[i] = msgs[i].second;
+            }
+            addFilteredItems(factory, bucket, loadBucketFieldsCH.get(bucket),
+                [&bucket](const RoutedId& id) {
+                    bucket.itemIds_.push_back(id.first);
+                    bucket.itemRoutes_.push_back(id.second);
+            });
+            summarizeBucket(bucket);
+    });
+
+    if (husky::Context::get_global_tid() == 0)
+        husky::LOG_I << "(in loadLocalItems) finish: load items" << std::endl;
+
+    statTableSizes(bucket_list, factory);
+}
+
 // assume inputPath is set for intputformat
 template<typename QueryType,
          typename ItemIdType, typename ItemElementType, typename InputFormat >
 void loadQueries(
     husky::ObjList<QueryType>& query_list,
-    void (*setItem)(boost::string_ref&, ItemIdType&, vector<ItemElementType>&),
+    void (*setItem)(boost::string_ref&, ItemIdType&, ItemVector<ItemElementType>&),
     InputFormat& infmt) {
 
     if (husky::Context::get_global_tid() == 0) {
@@ -123,7 +465,7 @@ void loadQueries(
 
     auto& loadQueryCH = 
         husky::ChannelStore::create_push_channel<
-            vector<ItemElementType>>(infmt, query_list);
+            ItemVector<ItemElementType>>(infmt, query_list);
 
     husky::load(infmt, 
         item_loader(loadQueryCH, setItem));
@@ -150,23 +492,25 @@ void broadcastQueries(
     LSHFactory<ItemIdType, ItemElementType>& factory,
     husky::ObjList<QueryType>& query_list){
 
-    std::function<void(ItemIdType&, std::vector<ItemElementType>& ) > query_handler = 
-            [&](ItemIdType& first, std::vector<ItemElementType>& second){
+    std::function<void(ItemIdType&, ItemVector<ItemElementType>& ) > query_handler = 
+            [&](ItemIdType& first, ItemVector<ItemElementType>& second){
                 factory.insertQueryVector(first, second);
             };
-    broadcastQueries( query_handler, query_list);
+    broadcastQueries<ItemIdType, ItemElementType>(query_handler, query_list,
+        [&factory](){ factory.finishQueries(); });
 }
 
 template<
     typename ItemIdType, typename ItemElementType, typename QueryType>
 void broadcastQueries(
-    std::function<void(ItemIdType&, std::vector<ItemElementType>& ) > query_handler,
-    husky::ObjList<QueryType>& query_list){
-    // define query aggregator and set up _idToQueryVector in factory
+    std::function<void(ItemIdType&, ItemVector<ItemElementType>& ) > query_handler,
+    husky::ObjList<QueryType>& query_list,
+    std::function<void()> finish_handler = nullptr){
+    // define query aggregator and set up the query store in factory
     if (husky::Context::get_global_tid() == 0) {
         husky::LOG_I << "in broadcastQueries" << std::endl;
     }
-    typedef std::pair<ItemIdType, std::vector<ItemElementType>> IdVectorPair;
+    typedef std::pair<ItemIdType, ItemVector<ItemElementType>> IdVectorPair;
 
     int numProcesses = husky::Context::get_num_processes();
     int numAggs = numProcesses* 2;
@@ -185,12 +529,15 @@ void broadcastQueries(
     husky::lib::AggregatorFactory::sync();
     // should flush 
     // insert broadcast query to factory, call once
-    std::call_once(broadcast_flag, [&query_handler, &aggs](){
+    std::call_once(broadcast_flag, [&query_handler, &finish_handler, &aggs](){
         for (auto& agg : aggs) {
             for (auto& p  : agg.get_value()) {
                 query_handler(p.first, p.second);
             }
         }
+        if (finish_handler) {
+            finish_handler();
+        }
     });
     if (husky::Context::get_global_tid() == 0) {
         husky::LOG_I << "finished broadcastQueries" << std::endl;
@@ -198,14 +545,152 @@ void broadcastQueries(
 }
 
 
+/*
+ * Self-join of the loaded items, without queries: every bucket pairs up its
+ * items and sends the larger id of each pair to the smaller one, which drops
+ * partners already found in other tables and sends its vector to each of
+ * them. The larger item computes the distance and writes
+ * (smaller id, larger id, distance), so every colliding pair is evaluated
+ * and written once. In radius mode pairs farther than the radius of the
+ * smaller id are dropped, as the queries of the app would, and buckets do not
+ * send the pairs the sketch prefilter rejects; otherwise pairs farther than
+ * distanceThreshold, if set. A bucket of n items yields n(n - 1) / 2 pairs.
+ * */
+template<typename BucketType, typename ItemType, typename FactoryType>
+void selfJoin(
+    FactoryType& factory,
+    husky::ObjList<BucketType>& bucket_list,
+    husky::ObjList<ItemType>& item_list,
+    bool localItems) {
+
+    typedef typename FactoryType::IdT ItemIdType;
+    typedef typename FactoryType::ElementT ItemElementType;
+    typedef DenseVector<ItemIdType, ItemElementType> VectorMsg;
+    // partner id and its route key, -1 unless items are local
+    typedef std::pair<ItemIdType, int> PartnerMsg;
+    typedef ItemInbox<ItemIdType, PartnerMsg> PartnerInbox;
+    typedef ItemInbox<ItemIdType, VectorMsg> VectorInbox;
+
+    if (husky::Context::get_global_tid() == 0)
+        husky::LOG_I << "start: self-join of the items" << std::endl;
+    auto join_start = std::chrono::steady_clock::now();
+
+    const auto& radiusFilter = factory.getRadiusFilter();
+    std::string thresholdParam = husky::Context::get_param("distanceThreshold");
+    float threshold = thresholdParam.empty() ? std::numeric_limits<float>::max() : std::stof(thresholdParam);
+
+    auto& partnerCH =
+        husky::ChannelStore::create_push_channel<PartnerMsg>(bucket_list, item_list);
+    auto& vectorCH =
+        husky::ChannelStore::create_push_channel<VectorMsg>(item_list, item_list);
+    auto& partner_inbox_list = husky::ObjListStore::create_objlist<PartnerInbox>();
+    auto& vector_inbox_list = husky::ObjListStore::create_objlist<VectorInbox>();
+    auto& partnerInboxCH =
+        husky::ChannelStore::create_push_channel<
+            std::pair<PartnerMsg, ItemIdType>>(bucket_list, partner_inbox_list);
+    auto& vectorInboxCH =
+        husky::ChannelStore::create_push_channel<
+            std::pair<VectorMsg, ItemIdType>>(item_list, vector_inbox_list);
+
+    // pairs of every bucket go to their smaller item
+    husky::list_execute(bucket_list,
+        {}, {&partnerCH, &partnerInboxCH},
+        [&radiusFilter, &partnerCH, &partnerInboxCH, localItems](BucketType& bucket) {
+            const auto& ids = bucket.itemIds_;
+            const auto& sketches = bucket.itemSketches_;
+            for (size_t i = 0; i < ids.size(); ++i) {
+                for (size_t j = i + 1; j < ids.size(); ++j) {
+                    if (ids[i] == ids[j]) continue;
+                    size_t a = ids[i] < ids[j] ? i : j;
+                    size_t b = a == i ? j : i;
+                    if (radiusFilter.sketchEnabled()
+                        && radiusFilter.rejects(sketches[a], sketches[b], radiusFilter.getRadiusOf(ids[a]))) continue;
+                    if (localItems) {
+                        partnerInboxCH.push(std::make_pair(PartnerMsg(ids[b], bucket.itemRoutes_[b]), ids[a]),
+                            bucket.itemRoutes_[a]);
+                    } else {
+                        partnerCH.push(PartnerMsg(ids[b], -1), ids[a]);
+                    }
+                }
+            }
+    });
+    if (localItems) {
+        husky::list_execute(partner_inbox_list,
+            {&partnerInboxCH}, {},
+            [&partnerInboxCH](PartnerInbox& inbox) {
+                PartnerInbox::deliver(partnerInboxCH.get(inbox));
+        });
+    }
+
+    // the smaller item of each distinct pair sends its vector once
+    husky::list_execute(item_list,
+        {&partnerCH}, {&vectorCH, &vectorInboxCH},
+        [&partnerCH, &vectorCH, &vectorInboxCH, localItems](ItemType& item) {
+            const vector<PartnerMsg>& partners = localItems
+                ? PartnerInbox::getMsgs(item.getItemId())
+                : partnerCH.get(item);
+            if (partners.empty()) return;
+
+            static thread_local std::unordered_set<ItemIdType> sent;
+            sent.clear();
+            VectorMsg msg(item);
+            for (const auto& partner : partners) {
+                if (!sent.insert(partner.first).second) continue;
+                if (localItems) {
+                    vectorInboxCH.push(std::make_pair(msg, partner.first), partner.second);
+                } else {
+                    vectorCH.push(msg, partner.first);
+                }
+            }
+    });
+    if (localItems) {
+        PartnerInbox::clear();
+        husky::list_execute(vector_inbox_list,
+            {&vectorInboxCH}, {},
+            [&vectorInboxCH](VectorInbox& inbox) {
+                VectorInbox::deliver(vectorInboxCH.get(inbox));
+        });
+    }
+
+    // the larger item computes the distances
+    husky::list_execute(item_list,
+        {&vectorCH}, {},
+        [&factory, &radiusFilter, &vectorCH, threshold, localItems](ItemType& item) {
+            const vector<VectorMsg>& others = localItems
+                ? VectorInbox::getMsgs(item.getItemId())
+                : vectorCH.get(item);
+            ScopedScatter<ItemSpan<ItemElementType>> scatter(item.getItemSpan(), others.size() > 1);
+            for (const auto& otherVector : others) {
+                float radius = threshold;
+                if (radiusFilter.enabled()) {
+                    radius = radiusFilter.getRadiusOf(otherVector.getItemId());
+                }
+                float dist = factory.calDist(otherVector.getItemSpan(), item.getItemSpan());
+                if (dist <= radius) {
+                    writeHDFSTriplet(otherVector.getItemId(), item.getItemId(), dist, "hdfs_namenode", "hdfs_namenode_port", "outputPath");
+                }
+            }
+    });
+    if (localItems) {
+        VectorInbox::clear();
+    }
+
+    auto join_finished = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::milli> d_join = join_finished - join_start;
+    if (husky::Context::get_global_tid() == 0)
+        husky::LOG_I << "finished: self-join of the items in "
+            << std::to_string(d_join.count() / 1000.0)
+            << " seconds" << std::endl;
+}
+
 template<
     typename QueryType, typename BucketType, typename ItemType,
     typename QueryMsg, typename AnswerMsg, 
-    typename ItemIdType, typename ItemElementType, 
+    typename FactoryType,
     typename InputFormat>
 void loshaengine(
-    LSHFactory<ItemIdType, ItemElementType>& factory,
-    void (*setItem)(boost::string_ref&, ItemIdType& itemId, vector<ItemElementType>&),
+    FactoryType& factory,
+    void (*setItem)(boost::string_ref&, typename FactoryType::IdT& itemId, typename FactoryType::VectorT&),
     InputFormat& infmt, 
     std::string itemPath,
     std::string queryPath,
@@ -221,15 +706,30 @@ void loshaengine(
         husky::ObjListStore::create_objlist<ItemType>();
     auto & bucket_list = husky::ObjListStore::create_objlist<BucketType>();
     infmt.set_input(itemPath);
-    loadItems(factory, bucket_list, item_list, setItem, infmt);
+    // loadMode=local keeps items where they are read, saving the shuffle of
+    // all item vectors at load time
+    bool localItems = husky::Context::get_param("loadMode") == "local";
+    if (localItems) {
+        loadLocalItems(factory, bucket_list, item_list, setItem, infmt);
+    } else {
+        loadItems(factory, bucket_list, item_list, setItem, infmt);
+    }
+
+    // selfJoin=1 joins the items with each other, queryPath is not read
+    if (!isQueryMode || husky::Context::get_param("selfJoin") == "1") {
+        selfJoin(factory, bucket_list, item_list, localItems);
+        return;
+    }
 
     auto & query_list =
         husky::ObjListStore::create_objlist<QueryType>();
     infmt.set_input(queryPath);
-    loadQueries(query_list, setItem, infmt);
+    typedef typename FactoryType::IdT ItemIdType;
+    typedef typename FactoryType::ElementT ItemElementType;
+    loadQueries<QueryType, ItemIdType, ItemElementType>(query_list, setItem, infmt);
 
     // end of debug
-    broadcastQueries(factory, query_list);
+    broadcastQueries<ItemIdType, ItemElementType>(factory, query_list);
 
     if (husky::Context::get_global_tid() == 0) 
         husky::LOG_I << "\n\nstart: similar items search for queries in batches" << std::endl;
@@ -245,25 +745,87 @@ void loshaengine(
         husky::ChannelStore::create_push_channel<
             AnswerMsg>(item_list, query_list);
 
+    // with local items, buckets forward to the inbox of the item's worker
+    typedef ItemInbox<ItemIdType, QueryMsg> InboxType;
+    auto & inbox_list = husky::ObjListStore::create_objlist<InboxType>();
+    auto& bucket2InboxCH =
+        husky::ChannelStore::create_push_channel<
+            std::pair<QueryMsg, ItemIdType>>(bucket_list, inbox_list);
+
+    // probeBudget caps the items a query reaches over all iterations,
+    // buckets report their sizes first and the query probes smallest first
+    std::string budgetParam = husky::Context::get_param("probeBudget");
+    size_t probeBudget = budgetParam.empty() ? 0 : std::stoul(budgetParam);
+    typedef ProbeBudget<ItemIdType, QueryMsg> BudgetType;
+    auto& sizeRequestCH =
+        husky::ChannelStore::create_push_channel<ItemIdType>(query_list, bucket_list);
+    auto& sizeReplyCH =
+        husky::ChannelStore::create_push_channel<
+            std::pair<BucketKey, int>>(bucket_list, query_list);
+    auto& budgetedCH =
+        husky::ChannelStore::create_push_channel<
+            std::pair<QueryMsg, int>>(query_list, bucket_list);
+
     double accumualteIterationTime = 0.0;
+    int numRounds = 0;
     for (int iter = 0; iter < ITERATION; ++iter) {
         if (husky::Context::get_global_tid() == 0) 
             husky::LOG_I << "start iteration: " + std::to_string(iter) << std::endl;
 
         auto time_iter_start = std::chrono::steady_clock::now();
 
+        // queries still probing after this round, the search stops once none is
+        husky::lib::Aggregator<unsigned> activeAgg(0,
+            [](unsigned& a, const unsigned& b) { a += b; });
+        auto& ac = husky::lib::AggregatorFactory::get_channel();
+
         // execute queries
         husky::list_execute(query_list,
-            [&factory, &item2QueryCH, &query2BucketCH](QueryType& query) {
+            {&item2QueryCH}, {&query2BucketCH, &sizeRequestCH, &ac},
+            [&factory, &item2QueryCH, &query2BucketCH, &sizeRequestCH, &activeAgg, probeBudget](QueryType& query) {
                 if (query.finished) return;
                 auto& inMsg = item2QueryCH.get(query);
                 query.query(factory, inMsg);
+                if (!query.finished) activeAgg.update(1);
+                if (probeBudget != 0 && !QueryType::query_msg_buffer.empty()) {
+                    BudgetType::local().request(query.getItemId(), query.queryMsg, probeBudget);
+                    for (auto& bId : QueryType::query_msg_buffer) {
+                        sizeRequestCH.push(query.getItemId(), bId);
+                    }
+                    QueryType::query_msg_buffer.clear();
+                    return;
+                }
                 for (auto& bId : QueryType::query_msg_buffer) {
                     query2BucketCH.push(query.queryMsg, bId);
                 }
                 QueryType::query_msg_buffer.clear();
         });
 
+        if (probeBudget != 0) {
+            // buckets report their sizes, queries spend their budget smallest first
+            husky::list_execute(bucket_list,
+                {&sizeRequestCH}, {&sizeReplyCH},
+                [&sizeRequestCH, &sizeReplyCH](BucketType& bucket) {
+                    int size = bucket.itemIds_.size();
+                    for (auto& queryId : sizeRequestCH.get(bucket)) {
+                        sizeReplyCH.push(std::make_pair(bucket.bucketId_, size), queryId);
+                    }
+            });
+            husky::list_execute(query_list,
+                {&sizeReplyCH}, {&budgetedCH},
+                [&sizeReplyCH, &budgetedCH](QueryType& query) {
+                    auto sizes = sizeReplyCH.get(query);
+                    BudgetType::local().allot(query.getItemId(), sizes,
+                        [&budgetedCH](const QueryMsg& msg, const BucketKey& bId, int quota) {
+                        budgetedCH.push(std::make_pair(msg, quota), bId);
+                    });
+            });
+        }
+
+        husky::lib::AggregatorFactory::sync();
+        if (activeAgg.get_value() == 0) break;
+        numRounds = iter + 1;
+
         auto time_query_finished = std::chrono::steady_clock::now();
         std::chrono::duration<double, std::milli> d_query = time_query_finished - time_iter_start;
         if (husky::Context::get_global_tid() == 0) 
@@ -273,19 +835,75 @@ void loshaengine(
 
         // execute buckets
         husky::list_execute(bucket_list, 
-            {&query2BucketCH}, {&bucket2ItemCH}, 
-            [&factory, &query2BucketCH, &bucket2ItemCH](BucketType& bucket) {
-
+            {&query2BucketCH, &budgetedCH}, {&bucket2ItemCH, &bucket2InboxCH}, 
+            [&factory, &query2BucketCH, &budgetedCH, &bucket2ItemCH, &bucket2InboxCH, localItems](BucketType& bucket) {
+
+                auto forward = [&](const QueryMsg& msg, size_t i) {
+                    if (localItems) {
+                        bucket2InboxCH.push(std::make_pair(msg, bucket.itemIds_[i]),
+                            bucket.itemRoutes_[i]);
+                    } else {
+                        bucket2ItemCH.push(msg, bucket.itemIds_[i]);
+                    }
+                };
+                // with attribute filters, items the query's predicate rejects are
+                // not forwarded, nor is anything if the bucket summary rejects it;
+                // with the sketch prefilter, neither are the items whose sketches
+                // are too far from the query's
+                const auto& attrFilter = factory.getAttributeFilter();
+                const auto& radiusFilter = factory.getRadiusFilter();
+                bool filtered = attrFilter.enabled() || radiusFilter.sketchEnabled();
+                const AttrPredicate* pred = nullptr;
+                int slot = -1;
+                auto filterQuery = [&](const QueryMsg& msg) {
+                    if (!filtered) return true;
+                    slot = factory.getQuerySlot(queryIdOf(msg));
+                    if (!attrFilter.enabled()) return true;
+                    pred = &attrFilter.getPredicate(slot);
+                    return bucket.attrSummary_.mayMatch(*pred);
+                };
+                auto forwardIfAccepted = [&](const QueryMsg& msg, size_t i) {
+                    if (pred != nullptr && !pred->accepts(bucket.itemAttrs_[i])) return;
+                    if (radiusFilter.sketchEnabled() && radiusFilter.rejects(slot, bucket.itemSketches_[i])) return;
+                    forward(msg, i);
+                };
                 for (auto& msg : query2BucketCH.get(bucket)) {
+                    if (!filterQuery(msg)) continue;
+                    if (filtered) {
+                        for (size_t i = 0; i < bucket.itemIds_.size(); ++i) {
+                            forwardIfAccepted(msg, i);
+                        }
+                        continue;
+                    }
                     // forward query, should do message reduction
+                    if (localItems) {
+                        for (size_t i = 0; i < bucket.itemIds_.size(); ++i) {
+                            forward(msg, i);
+                        }
+                        continue;
+                    }
                     for (auto& itemId : bucket.itemIds_) {
                         // bucket2ItemCH.push<husky::IdenCombine>(msg, itemId, item_list);
                         // worker.send_message(msg, itemId, item_list);
                         bucket2ItemCH.push(msg, itemId);
                     }
                 }
+                // over budget buckets forward an evenly strided subset
+                for (auto& msg : budgetedCH.get(bucket)) {
+                    if (!filterQuery(msg.first)) continue;
+                    BudgetType::sample(bucket.itemIds_.size(), msg.second,
+                        [&](size_t i) { forwardIfAccepted(msg.first, i); });
+                }
         });
 
+        if (localItems) {
+            husky::list_execute(inbox_list,
+                {&bucket2InboxCH}, {},
+                [&bucket2InboxCH](InboxType& inbox) {
+                    InboxType::deliver(bucket2InboxCH.get(inbox));
+            });
+        }
+
         auto time_bucket_finished = std::chrono::steady_clock::now();
         std::chrono::duration<double, std::milli> d_forward = time_bucket_finished - time_query_finished;
         if (husky::Context::get_global_tid() == 0) 
@@ -295,13 +913,19 @@ void loshaengine(
 
         // execute Items
         husky::list_execute(item_list,
-            [&factory, &bucket2ItemCH](ItemType& item) {
+            [&factory, &bucket2ItemCH, localItems](ItemType& item) {
 
-            const vector<QueryMsg>& inMsg = bucket2ItemCH.get(item);
+            const vector<QueryMsg>& inMsg = localItems
+                ? InboxType::getMsgs(item.getItemId())
+                : bucket2ItemCH.get(item);
 
             item.answer(factory, inMsg);
 
         });
+        ItemType::flushAnswers(factory);
+        if (localItems) {
+            InboxType::clear();
+        }
 
         for (auto& pair : ItemType::item_msg_buffer) {
             item2QueryCH.push(pair.second, pair.first);
@@ -342,6 +966,10 @@ void loshaengine(
                 << std::to_string(accumualteIterationTime) + " seconds" << std::endl;
     }
 
+    if (husky::Context::get_global_tid() == 0)
+        husky::LOG_I << "queries probed in " << numRounds
+            << " of " << ITERATION << " rounds" << std::endl;
+
     auto job_finished = std::chrono::steady_clock::now();
     std::chrono::duration<double, std::milli> d_job = job_finished - job_start;
     if (husky::Context::get_global_tid() == 0) 
@@ -4,7 +4,14 @@
 #include <unordered_map>
 #include <vector>
 
+#include "attrfilter.hpp"
+#include "bucketkey.hpp"
 #include "densevector.hpp"
+#include "querystore.hpp"
+#include "pqcodes.hpp"
+#include "radiusfilter.hpp"
+#include "losha/common/distor.hpp"
+#include "losha/common/span.hpp"
 
 using std::vector;
 
@@ -14,21 +21,31 @@ namespace losha {
 template<typename ItemIdType, typename ItemElementType>
 class LSHFactory {
 public:
+    using IdT = ItemIdType;
+    using ElementT = ItemElementType;
+    using VectorT = ItemVector<ItemElementType>;
+
     int _band;
     int _row;
     int _dimension;
-    std::unordered_map<ItemIdType, std::vector<ItemElementType>> _idToQueryVector;
+    QueryStore<ItemIdType, ItemElementType> _queries;
+    RadiusFilter<ItemIdType> _radiusFilter;
+    PQReranker _reranker;
+    AttributeFilter<ItemIdType> _attrFilter;
+
+    using SpanT = ItemSpan<ItemElementType>;
 
     // three most important virtual functions, calDist, oldCalSigs and calProjs
+    // they take views, so both owned vectors and items in the ItemStore can be passed
     virtual float calDist(
-        const vector<ItemElementType> & query,
-        const vector<ItemElementType> & item) const = 0;
+        SpanT query,
+        SpanT item) const = 0;
 
     virtual vector< vector<int> > calSigs( 
-        const vector<ItemElementType> &itemVector) const = 0;
+        SpanT itemVector) const = 0;
 
     virtual vector< vector<float> > calProjs(
-        const vector<ItemElementType> &itemVector) const {
+        SpanT itemVector) const {
 
         // should return an error since it only belongs to E2LSH
         vector< vector<float> > zero;
@@ -36,41 +53,69 @@ public:
     }
 
     // wrapper for DenseVector
+    template<bool QueryInStore, bool ItemInStore>
     inline float calDist(
-        const DenseVector<ItemIdType, ItemElementType> & query,
-        const DenseVector<ItemIdType, ItemElementType> & item) const {
-        return calDist(query.getItemVector(), item.getItemVector() );
+        const DenseVector<ItemIdType, ItemElementType, QueryInStore> & query,
+        const DenseVector<ItemIdType, ItemElementType, ItemInStore> & item) const {
+        return calDist(query.getItemSpan(), item.getItemSpan() );
     }
 
     // wrapper for DenseVector
+    template<bool InStore>
     inline float calDist(
-        const vector<ItemElementType> & queryVector,
-        const DenseVector<ItemIdType, ItemElementType> & item) const {
-        return calDist(queryVector, item.getItemVector() );
+        SpanT queryVector,
+        const DenseVector<ItemIdType, ItemElementType, InStore> & item) const {
+        return calDist(queryVector, item.getItemSpan() );
     }
 
     // wrapper for DenseVector
+    template<bool InStore>
     inline float calDist(
-        const DenseVector<ItemIdType, ItemElementType> & query,
-        vector<ItemElementType> & itemVector) const {
-        return calDist(query.getItemVector(), itemVector );
+        const DenseVector<ItemIdType, ItemElementType, InStore> & query,
+        SpanT itemVector) const {
+        return calDist(query.getItemSpan(), itemVector );
+    }
+
+    // distances between x and n other vectors, written into out[0, n)
+    // virtual dispatch per pair, StaticLSHFactory hides it with an inlined loop
+    void calDists(
+        SpanT x,
+        const SpanT* others,
+        size_t n,
+        float* out) const {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = calDist(others[i], x);
+        }
+    }
+
+    // distances between x and the broadcast queries in slots[0, n)
+    void calQueryDists(
+        SpanT x,
+        const int* slots,
+        size_t n,
+        float* out) const {
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = calDist(_queries.getVector(slots[i]), x);
+        }
     }
 
     // wrapper for DenseVector
+    template<bool InStore>
     inline vector< vector<int> > calSigs(
-        const DenseVector<ItemIdType, ItemElementType> & item) const {
-        return calSigs(item.getItemVector() );
+        const DenseVector<ItemIdType, ItemElementType, InStore> & item) const {
+        return calSigs(item.getItemSpan() );
     }
     
     // wrapper for DenseVector
+    template<bool InStore>
     inline vector< vector<float> > calProjs(
-        const DenseVector<ItemIdType, ItemElementType> & item) const {
-        return calProjs(item.getItemVector() );
+        const DenseVector<ItemIdType, ItemElementType, InStore> & item) const {
+        return calProjs(item.getItemSpan() );
     }
 
     // wrapper to add table index 
     // directly get buckets for an object
-    vector< vector<int> > calItemBuckets( const vector<ItemElementType>& itemVector) const {
+    vector< vector<int> > calItemBuckets(SpanT itemVector) const {
         vector< vector<int> > sigInBands = this->calSigs(itemVector);
 
         vector< vector<int> >::iterator it = sigInBands.begin();
@@ -82,9 +127,23 @@ public:
     }
 
     // wrapper for DenseVector
+    template<bool InStore>
     vector< vector<int> > calItemBuckets(
-        const DenseVector<ItemIdType, ItemElementType>& p) const {
-        return calItemBuckets(p.getItemVector());
+        const DenseVector<ItemIdType, ItemElementType, InStore>& p) const {
+        return calItemBuckets(p.getItemSpan());
+    }
+
+    // buckets per item, calBucketsInto writes this many keys
+    virtual int getNumTables() const {
+        return _band;
+    }
+
+    // generic path through calSigs, StaticLSHFactory writes the keys without allocating
+    void calBucketsInto(SpanT itemVector, BucketKey* out) const {
+        vector< vector<int> > sigInBands = this->calSigs(itemVector);
+        for (int t = 0; t < sigInBands.size(); ++t) {
+            out[t] = BucketKey(sigInBands[t].data(), sigInBands[t].size(), t);
+        }
     }
 
     inline int getBand() const {
@@ -99,24 +158,55 @@ public:
         return _dimension;
     }
 
-    // Fetch broadcasted queries into _idToQueryVector
-    inline void insertQueryVector(int qid, const std::vector<ItemElementType>& qvec) {
-        if (_idToQueryVector.find(qid) != _idToQueryVector.end()) {
-            ASSERT_MSG(0, "query already exists");
-        }
-        _idToQueryVector[qid] = qvec;
+    // Fetch broadcasted queries into _queries, finishQueries() after the last one
+    inline void insertQueryVector(ItemIdType qid, const ItemVector<ItemElementType>& qvec) {
+        _queries.add(qid, qvec);
     }
 
-    const std::vector<ItemElementType>& getQueryVector(ItemIdType qid) {
-        ASSERT_MSG(_idToQueryVector.size() != 0, "All queries are processed");
-        if (_idToQueryVector.find(qid) == _idToQueryVector.end()) {
-            ASSERT_MSG(0, "cannot find query");
-        }
-        return _idToQueryVector[qid];
+    inline void finishQueries() {
+        _queries.finalize();
+        _radiusFilter.build(_queries);
+        _reranker.build(_queries);
+        _attrFilter.build(_queries);
+    }
+
+    inline int getQuerySlot(ItemIdType qid) const {
+        return _queries.getSlot(qid);
+    }
+
+    inline SpanT getQueryVector(ItemIdType qid) const {
+        return _queries.getVector(_queries.getSlot(qid));
     }
 
-    const std::unordered_map<ItemIdType, std::vector<ItemElementType>>& getAllQueries() const {
-        return _idToQueryVector;
+    const QueryStore<ItemIdType, ItemElementType>& getAllQueries() const {
+        return _queries;
+    }
+
+    // radius mode, initialized before loading when the app searches r-near neighbours
+    RadiusFilter<ItemIdType>& getRadiusFilter() {
+        return _radiusFilter;
+    }
+
+    const RadiusFilter<ItemIdType>& getRadiusFilter() const {
+        return _radiusFilter;
+    }
+
+    // PQ re-ranking, initialized and trained before loading if enabled
+    PQReranker& getReranker() {
+        return _reranker;
+    }
+
+    const PQReranker& getReranker() const {
+        return _reranker;
+    }
+
+    // attribute filters, configured before loading if enabled
+    AttributeFilter<ItemIdType>& getAttributeFilter() {
+        return _attrFilter;
+    }
+
+    const AttributeFilter<ItemIdType>& getAttributeFilter() const {
+        return _attrFilter;
     }
     // handle aggregator variable
 
@@ -282,5 +372,174 @@ public:
     // }
 };
 
+/*
+ * Compile-time layer over LSHFactory (CRTP). Derived implements
+ *     float calDistImpl(SpanT query, SpanT item) const;
+ *     void calSigsInto(SpanT item, int* out) const;
+ *     int getSigLength() const;  // ints per table
+ * and may override getNumTables() (default: band).
+ * calSigsInto writes the signature of table t to out[t * getSigLength(), (t + 1) * getSigLength()).
+ *
+ * Engine, query and item templates instantiated with the concrete factory
+ * type call these non-virtually, so the distance kernel is inlined into the
+ * answer loops. The virtual calDist/calSigs of LSHFactory are kept as a shim
+ * for code holding an LSHFactory reference.
+ * */
+template<typename Derived, typename ItemIdType, typename ItemElementType>
+class StaticLSHFactory : public LSHFactory<ItemIdType, ItemElementType> {
+public:
+    using typename LSHFactory<ItemIdType, ItemElementType>::VectorT;
+    using typename LSHFactory<ItemIdType, ItemElementType>::SpanT;
+    using LSHFactory<ItemIdType, ItemElementType>::calDist;
+    using LSHFactory<ItemIdType, ItemElementType>::calSigs;
+
+    inline const Derived& derived() const {
+        return *static_cast<const Derived*>(this);
+    }
+
+    // size of the buffer calSigsInto writes to
+    inline int getSigBufferSize() const {
+        return derived().getNumTables() * derived().getSigLength();
+    }
+
+    float calDist(SpanT query, SpanT item) const final {
+        return derived().calDistImpl(query, item);
+    }
+
+    // a distance > bound may be returned as any value > bound
+    inline float calDistBounded(SpanT query, SpanT item, float bound) const {
+        return derived().calDistBoundedImpl(query, item, bound);
+    }
+
+    // Derived may hide it with an early-abandoning kernel
+    inline float calDistBoundedImpl(SpanT query, SpanT item, float bound) const {
+        return derived().calDistImpl(query, item);
+    }
+
+    void calDists(
+        SpanT x,
+        const SpanT* others,
+        size_t n,
+        float* out) const {
+        const Derived& self = derived();
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = self.calDistImpl(others[i], x);
+        }
+    }
+
+    void calQueryDists(
+        SpanT x,
+        const int* slots,
+        size_t n,
+        float* out) const {
+        derived().calQueryDistsImpl(x, slots, n, out);
+    }
+
+    // Derived may hide it to use the norms kept in the query store
+    void calQueryDistsImpl(
+        SpanT x,
+        const int* slots,
+        size_t n,
+        float* out) const {
+        const Derived& self = derived();
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = self.calDistImpl(this->_queries.getVector(slots[i]), x);
+        }
+    }
+
+    // one key per table into out[0, getNumTables()), no allocation once the
+    // thread local signature buffer has grown to its final size
+    void calBucketsInto(SpanT itemVector, BucketKey* out) const {
+        const Derived& self = derived();
+        int numTables = self.getNumTables();
+        int sigLength = self.getSigLength();
+
+        static thread_local vector<int> sigBuffer;
+        sigBuffer.resize(numTables * sigLength);
+        self.calSigsInto(itemVector, sigBuffer.data());
+
+        const int* sig = sigBuffer.data();
+        for (int t = 0; t < numTables; ++t, sig += sigLength) {
+            out[t] = BucketKey(sig, sigLength, t);
+        }
+    }
+
+    vector< vector<int> > calSigs(SpanT itemVector) const final {
+        return calItemBuckets(itemVector, false);
+    }
+
+    // same layout as LSHFactory::calItemBuckets, table index appended
+    vector< vector<int> > calItemBuckets(SpanT itemVector, bool appendTable = true) const {
+        const Derived& self = derived();
+        int numTables = self.getNumTables();
+        int sigLength = self.getSigLength();
+
+        static thread_local vector<int> sigBuffer;
+        sigBuffer.resize(numTables * sigLength);
+        self.calSigsInto(itemVector, sigBuffer.data());
+
+        vector< vector<int> > buckets(numTables);
+        for (int t = 0; t < numTables; ++t) {
+            buckets[t].reserve(sigLength + 1);
+            buckets[t].assign(
+                sigBuffer.begin() + t * sigLength,
+                sigBuffer.begin() + (t + 1) * sigLength);
+            if (appendTable) buckets[t].push_back(t);
+        }
+        return buckets;
+    }
+
+    // wrapper for DenseVector
+    template<bool InStore>
+    vector< vector<int> > calItemBuckets(
+        const DenseVector<ItemIdType, ItemElementType, InStore>& p) const {
+        return calItemBuckets(p.getItemSpan());
+    }
+};
+
+/*
+ * StaticLSHFactory with Euclidean distances on dense vectors: the exact, the
+ * early-abandoning and the batched kernels of distor.hpp. The query vectors
+ * of a batch are gathered into a tile and evaluated against the item together.
+ * */
+template<typename Derived, typename ItemIdType, typename ItemElementType>
+class EuclideanLSHFactory : public StaticLSHFactory<Derived, ItemIdType, ItemElementType> {
+public:
+    using typename StaticLSHFactory<Derived, ItemIdType, ItemElementType>::SpanT;
+
+    inline float calDistImpl(SpanT query, SpanT item) const {
+        return calE2Dist(query, item);
+    }
+
+    inline float calDistBoundedImpl(SpanT query, SpanT item, float bound) const {
+        return calE2DistBounded(query, item, bound);
+    }
+
+    void calQueryDistsImpl(
+        SpanT x,
+        const int* slots,
+        size_t n,
+        float* out) const {
+        static thread_local vector<const ItemElementType*> tile;
+        tile.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            tile[i] = this->_queries.getVector(slots[i]).data();
+        }
+        calE2Dists(x, tile.data(), n, out);
+    }
+};
+
+// CRTP type of a factory that may be derived from once more:
+// FactorySelf<SimHashFactory<...>, void> is the factory itself, otherwise Derived
+template<typename Self, typename Derived>
+struct FactorySelf {
+    typedef Derived type;
+};
+
+template<typename Self>
+struct FactorySelf<Self, void> {
+    typedef Self type;
+};
+
 } // namespace losha
 } // namespace husky
@@ -1,5 +1,6 @@
 #pragma once
 #include <vector>
+#include <cstring>
 #include <utility>
 #include "lshcore/densevector.hpp"
 #include "lshcore/lshutils.hpp"
@@ -18,7 +19,7 @@ namespace losha {
     
 template<typename ItemIdType, typename ItemElementType>
 class APSimHashFactory:
-    public SimHashFactory<ItemIdType, ItemElementType> {
+    public SimHashFactory<ItemIdType, ItemElementType, APSimHashFactory<ItemIdType, ItemElementType>> {
 
 public:
     // default _band and _row are calculated by setBand and setRow
@@ -49,14 +50,33 @@ public:
         this->generateSimHashFunctions(seed);
     }
 
-    std::vector< std::vector<int> > calSigs(
-        const vector<ItemElementType> &p) const override {
-        std::vector<bool> bools = this->calSignaturesInBool(p);
+    // one table per pair of the m generated bands
+    int getNumTables() const override {
+        return _setBand;
+    }
+
+    inline int getSigLength() const {
+        return (_setRow + 31) / 32;
+    }
 
-        // expand allSignatures by all-pair lsh
-        auto allBools = concat(bools, this->getRow(), this->getBand());
-        assert(allBools.size() == _setBand * _setRow);
-        return this->boolsToSigs(allBools, _setRow, _setBand);
+    // expand the m bands by all-pair lsh, same order as concat
+    void calSigsInto(
+        ItemSpan<ItemElementType> p, int* out) const {
+        static thread_local std::vector<char> bits;
+        bits.resize(this->hashFunctions.size() * 2);
+        char* origin = bits.data();
+        char* pairBits = origin + this->hashFunctions.size();
+        this->calSignaturesInto(p, origin);
+
+        int numRows = this->getRow();
+        int numBands = this->getBand();
+        for (int l = 0; l < numBands - 1; ++l) {
+            memcpy(pairBits, origin + l * numRows, numRows);
+            for (int r = l + 1; r < numBands; ++r) {
+                memcpy(pairBits + numRows, origin + r * numRows, numRows);
+                out = this->bitsToInts(pairBits, _setRow, out);
+            }
+        }
     }
 
 protected:
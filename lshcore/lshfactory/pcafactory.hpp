@@ -32,7 +32,7 @@ namespace losha {
 
 template<typename ItemIdType, typename ItemElementType>
 class PCAFactory:
-    public LSHFactory<ItemIdType, ItemElementType> {
+    public EuclideanLSHFactory<PCAFactory<ItemIdType, ItemElementType>, ItemIdType, ItemElementType> {
 private:
     PCAHasher<ItemElementType> hasher;
 public:
@@ -44,25 +44,22 @@ public:
         this->_dimension = hasher.getDimension();
     }
 
-    // return signatures of each band
-    // in the format of std::vector< std::vector<int> >
-    std::vector< std::vector<int> > calSigs (
-        // const DenseVector<ItemIdType, ItemElementType> &p) override {
-        const vector<ItemElementType> &itemVector) const override {
-
-        std::vector< std::vector<int> > signatureInBands;
-        signatureInBands.reserve(this->getBand());
+    // pcahasher packs the bits of a table into a single int
+    inline int getSigLength() const {
+        return 1;
+    }
 
+    void calSigsInto(
+        ItemSpan<ItemElementType> itemVector, int* out) const {
         for (int i = 0; i < this->_band; ++i) {
-            signatureInBands.emplace_back(hasher.getBuckets(i, itemVector.data()));
+            out[i] = hasher.getBuckets(i, itemVector.data())[0];
         }
-        return signatureInBands;
     }
 
     // return projections of each band
     // in the format of std::vector< std::vector<float> >
     virtual std::vector< std::vector<float> > calProjs(
-        const vector<ItemElementType> &itemVector) const override {
+        ItemSpan<ItemElementType> itemVector) const override {
 
         std::vector< std::vector<float> > projectionsInBands;
         projectionsInBands.reserve(this->getBand());
@@ -72,13 +69,6 @@ public:
         }
         return projectionsInBands;
     }
-
-    virtual float calDist(
-            const std::vector<ItemElementType> & queryVector,
-            const std::vector<ItemElementType> & itemVector) const override {
-        return calE2Dist(queryVector, itemVector);
-    }
-
 };
 
 } // namespace losha
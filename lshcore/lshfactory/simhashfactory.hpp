@@ -12,9 +12,13 @@
 
 namespace husky {
 namespace losha {
-template<typename ItemIdType, typename ItemElementType>
+// Derived is set by factories extending SimHash (APSimHashFactory) so that
+// StaticLSHFactory dispatches to their calSigsInto
+template<typename ItemIdType, typename ItemElementType, typename Derived = void>
 class SimHashFactory:
-    public LSHFactory<ItemIdType, ItemElementType> {
+    public StaticLSHFactory<
+        typename FactorySelf<SimHashFactory<ItemIdType, ItemElementType, Derived>, Derived>::type,
+        ItemIdType, ItemElementType> {
 public:
     std::vector< SimHashFunction<ItemElementType> >  hashFunctions;
 
@@ -45,29 +49,71 @@ public:
         }
     }
 
-    // compress into std vector<int>
-    std::vector< std::vector<int> > calSigs(
-        const vector<ItemElementType> &p) const override {
-        std::vector<bool> allSignatures = this->calSignaturesInBool(p);
+    // every 32 bits of a band are compressed into one int
+    inline int getSigLength() const {
+        return (this->_row + 31) / 32;
+    }
 
-        int numRows = this->getRow();
-        int numBands =  this->getBand();
+    void calSigsInto(
+        ItemSpan<ItemElementType> p, int* out) const {
+        static thread_local std::vector<char> bits;
+        bits.resize(hashFunctions.size());
+        calSignaturesInto(p, bits.data());
 
-        return boolsToSigs(allSignatures, numRows, numBands);
+        for (int i = 0; i < this->_band; ++i) {
+            out = bitsToInts(bits.data() + i * this->_row, this->_row, out);
+        }
     }
 
     // for denseVector, NO ASSUMPTION a * b / |a| / |b|
-    virtual float calDist(
-           const std::vector<ItemElementType> & queryVector,
-           const std::vector<ItemElementType> & itemVector) const override {
+    inline float calDistImpl(
+           ItemSpan<ItemElementType> queryVector,
+           ItemSpan<ItemElementType> itemVector) const {
 
         return calAngularDist(queryVector, itemVector);
     }
 
+    // the item norm is computed once, query norms come from the query store
+    void calQueryDistsImpl(
+           ItemSpan<ItemElementType> itemVector,
+           const int* slots,
+           size_t n,
+           float* out) const {
+
+        const auto& queries = this->getAllQueries();
+        float itemNorm = calL2Norm(itemVector);
+        for (size_t i = 0; i < n; ++i) {
+            out[i] = calAngularDistWithNorms(queries.getVector(slots[i]), itemVector,
+                queries.getNorm(slots[i]), itemNorm);
+        }
+    }
+
 protected:
+    void calSignaturesInto(
+        ItemSpan<ItemElementType> p, char* bits) const {
+        for (auto& fun : this->hashFunctions) {
+            *bits++ = fun.getBucket(p);
+        }
+    }
+
+    // same packing as boolsToInts: most significant bit first, 32 bits per int,
+    // the last int holds the remaining numBits % 32 bits
+    static int* bitsToInts(const char* bits, int numBits, int* out) {
+        int iter = 0;
+        while (iter < numBits) {
+            int value = 0;
+            for (int i = 0; i < 32 && iter < numBits; ++i) {
+                value <<= 1;
+                value += bits[iter++];
+            }
+            *out++ = value;
+        }
+        return out;
+    }
+
     // for denseVector
     std::vector<bool> calSignaturesInBool(
-        const vector<ItemElementType>& p) const {
+        const ItemVector<ItemElementType>& p) const {
         std::vector<bool> allSignatures;
         allSignatures.resize(this->hashFunctions.size());
 
@@ -24,13 +24,13 @@ public:
 
     // for both denseVector and sparse vector
     inline float getProjection(
-        const std::vector<ItemElementType>& itemVector) const {
+        ItemSpan<ItemElementType> itemVector) const {
         return dotProduct(_a, itemVector);
     }
 
     // for bot denseVector and sparse vector
     bool getBucket(
-        const std::vector<ItemElementType>& itemVector) const {
+        ItemSpan<ItemElementType> itemVector) const {
         if (this->getProjection(itemVector) >= 0)
             return true;
         else
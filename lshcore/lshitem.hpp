@@ -15,24 +15,63 @@
  */
 
 #pragma once
+#include <condition_variable>
+#include <limits>
+#include <mutex>
 #include <string>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include "base/log.hpp"
 #include "core/engine.hpp"
 
+#include "boundedquerymsg.hpp"
 #include "densevector.hpp"
 #include "lshfactory.hpp"
 
 namespace husky {
 namespace losha {
 
+/*
+ * Barrier of the local workers of a process, reusable across iterations. The
+ * last worker to arrive runs onLast before any of them leaves.
+ * */
+class LocalBarrier {
+public:
+    template<typename FnT>
+    void wait(FnT onLast) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        unsigned generation = _generation;
+        if (++_numArrived < husky::Context::get_num_local_workers()) {
+            _cv.wait(lock, [&] { return _generation != generation; });
+            return;
+        }
+        onLast();
+        _numArrived = 0;
+        ++_generation;
+        _cv.notify_all();
+    }
+
+    void wait() {
+        wait([] {});
+    }
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cv;
+    int _numArrived = 0;
+    unsigned _generation = 0;
+};
+
 template<typename ItemIdType,
          typename ItemElementType,
          typename QueryMsg = DenseVector<ItemIdType, ItemElementType>,
-         typename AnswerMsg = std::pair<ItemIdType, float> >
-class LSHItem: public DenseVector<ItemIdType, ItemElementType> {
+         typename AnswerMsg = std::pair<ItemIdType, float>,
+         typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
+class LSHItem: public DenseVector<ItemIdType, ItemElementType, true> {
 public:
 
     static thread_local std::vector< std::pair<ItemIdType, AnswerMsg> > item_msg_buffer;
@@ -40,8 +79,9 @@ public:
     static thread_local std::unordered_map<ItemIdType, std::vector<AnswerMsg>> topk_item_msg_buffer;
 
     // require by Husky object
-    explicit LSHItem(const typename LSHItem::KeyT& id) : DenseVector<ItemIdType, ItemElementType>(id) {};
-    LSHItem() : DenseVector<ItemIdType, ItemElementType>() {}
+    // item vectors live in the ItemStore of the worker
+    explicit LSHItem(const typename LSHItem::KeyT& id) : DenseVector<ItemIdType, ItemElementType, true>(id) {};
+    LSHItem() : DenseVector<ItemIdType, ItemElementType, true>() {}
 
     inline void sendToQuery(const ItemIdType& qId, const AnswerMsg& msg) {
         item_msg_buffer.emplace_back(std::make_pair(qId, msg));
@@ -66,28 +106,220 @@ public:
     }
 
     virtual void answer(
-        LSHFactory<ItemIdType, ItemElementType>& factory,
+        FactoryType& factory,
         const vector<QueryMsg>& inMsg) {
     }
+
+    // called by the engine on every thread after the items of an iteration,
+    // for items that batch their work across answer() calls
+    static void flushAnswers(FactoryType& factory) {}
+
+    // PQ code for the re-ranking stage, set at load if it is enabled
+    inline void setPQCode(Span<const uint8_t> code) { _pqCode = code; }
+    inline Span<const uint8_t> getPQCode() const { return _pqCode; }
+
+    // attributes for filtered search, set at load if it is enabled
+    inline void setAttributes(const ItemAttributes& attrs) { _attrs = attrs; }
+    inline const ItemAttributes& getAttributes() const { return _attrs; }
+
+protected:
+    // distinct queries of inMsgs in arrival order and their distances to this
+    // item, filled by calQueryDists and valid until its next call
+    static thread_local std::vector<ItemIdType> batch_query_ids;
+    static thread_local std::vector<float> batch_dists;
+
+    // for QueryMsg being a query id: drops repeated ids, then evaluates all
+    // distances with one factory.calQueryDists call over query store slots
+    size_t calQueryDists(FactoryType& factory, const vector<QueryMsg>& inMsgs) {
+        static thread_local std::unordered_set<ItemIdType> evaluated;
+        static thread_local std::vector<int> querySlots;
+        evaluated.clear();
+        batch_query_ids.clear();
+        querySlots.clear();
+        const auto& attrFilter = factory.getAttributeFilter();
+        for (const auto& queryId : inMsgs) {
+            if (!evaluated.insert(queryId).second) continue;
+            int slot = factory.getQuerySlot(queryId);
+            if (attrFilter.rejects(slot, _attrs)) continue;
+            batch_query_ids.push_back(queryId);
+            querySlots.push_back(slot);
+        }
+
+        size_t n = batch_query_ids.size();
+        batch_dists.resize(n);
+        factory.calQueryDists(this->getItemSpan(), querySlots.data(), n, batch_dists.data());
+        return n;
+    }
+
+    // radius mode: like calQueryDists, but keeps only the queries within their
+    // radius; the buckets already dropped the queries the sketch prefilter rejects
+    size_t calQueryDistsWithin(FactoryType& factory, const vector<QueryMsg>& inMsgs) {
+        static thread_local std::unordered_set<ItemIdType> evaluated;
+        static thread_local std::vector<int> querySlots;
+        const auto& filter = factory.getRadiusFilter();
+        ASSERT_MSG(filter.enabled(), "radius mode is not initialized");
+        evaluated.clear();
+        batch_query_ids.clear();
+        querySlots.clear();
+        for (const auto& queryId : inMsgs) {
+            if (!evaluated.insert(queryId).second) continue;
+            int slot = factory.getQuerySlot(queryId);
+            if (factory.getAttributeFilter().rejects(slot, _attrs)) continue;
+            batch_query_ids.push_back(queryId);
+            querySlots.push_back(slot);
+        }
+
+        batch_dists.resize(batch_query_ids.size());
+        factory.calQueryDists(this->getItemSpan(), querySlots.data(), querySlots.size(), batch_dists.data());
+        size_t n = 0;
+        for (size_t i = 0; i < querySlots.size(); ++i) {
+            if (batch_dists[i] <= filter.getRadius(querySlots[i])) {
+                batch_query_ids[n] = batch_query_ids[i];
+                batch_dists[n] = batch_dists[i];
+                ++n;
+            }
+        }
+        batch_query_ids.resize(n);
+        batch_dists.resize(n);
+        return n;
+    }
+
+    // for QueryMsg being a BoundedQueryMsg: leaves only the distinct queries
+    // whose top-k this item can enter. Unbounded queries are evaluated together
+    // with one factory.calQueryDists call, bounded ones one by one with an
+    // early-abandoning kernel.
+    size_t calQueryDistsBounded(FactoryType& factory, const vector<QueryMsg>& inMsgs) {
+        static thread_local std::unordered_set<ItemIdType> evaluated;
+        static thread_local std::vector<int> querySlots;
+        static thread_local std::vector<std::pair<int, const QueryMsg*>> bounded;
+        const auto& queries = factory.getAllQueries();
+        evaluated.clear();
+        batch_query_ids.clear();
+        querySlots.clear();
+        bounded.clear();
+        for (const auto& msg : inMsgs) {
+            if (!evaluated.insert(msg.queryId).second) continue;
+            int slot = factory.getQuerySlot(msg.queryId);
+            if (factory.getAttributeFilter().rejects(slot, _attrs)) continue;
+            if (msg.bound == std::numeric_limits<float>::max()) {
+                batch_query_ids.push_back(msg.queryId);
+                querySlots.push_back(slot);
+            } else {
+                bounded.emplace_back(slot, &msg);
+            }
+        }
+
+        batch_dists.resize(batch_query_ids.size());
+        factory.calQueryDists(this->getItemSpan(), querySlots.data(), querySlots.size(), batch_dists.data());
+        for (const auto& b : bounded) {
+            float dist = factory.calDistBounded(queries.getVector(b.first), this->getItemSpan(), b.second->bound);
+            if (dist <= b.second->bound) {
+                batch_query_ids.push_back(b.second->queryId);
+                batch_dists.push_back(dist);
+            }
+        }
+        return batch_query_ids.size();
+    }
+
+    // first stage of re-ranking: the distinct queries of inMsgs score this
+    // item by its PQ code, the topR best items of every query are kept in the
+    // thread's RerankBuffer until flushRerank
+    void offerForRerank(FactoryType& factory, const vector<QueryMsg>& inMsgs) {
+        static thread_local std::unordered_set<ItemIdType> evaluated;
+        const auto& reranker = factory.getReranker();
+        int numSlots = factory.getAllQueries().size();
+        auto& buffer = RerankBuffer<ItemIdType, ItemSpan<ItemElementType>>::local();
+        evaluated.clear();
+        for (const auto& queryId : inMsgs) {
+            if (!evaluated.insert(queryId).second) continue;
+            int slot = factory.getQuerySlot(queryId);
+            if (factory.getAttributeFilter().rejects(slot, _attrs)) continue;
+            buffer.offer(slot, numSlots, reranker.getTopR(),
+                reranker.adcDist(slot, _pqCode.data()), this->getItemId(), this->getItemSpan());
+        }
+    }
+
+    // second stage, called by every local worker once per iteration: the
+    // candidates of all threads are merged into the topR of the process, then
+    // each worker computes the exact distances of a strided share of its
+    // slots, fn(queryId, itemId, dist)
+    template<typename FnT>
+    static void flushRerank(FactoryType& factory, FnT fn) {
+        typedef RerankBuffer<ItemIdType, ItemSpan<ItemElementType>> BufferType;
+        static std::mutex mergeMutex;
+        static BufferType merged;
+        static LocalBarrier barrier;
+        const auto& queries = factory.getAllQueries();
+        int topR = factory.getReranker().getTopR();
+
+        {
+            std::lock_guard<std::mutex> lock(mergeMutex);
+            BufferType::local().drain([&](int slot, const std::vector<typename BufferType::Candidate>& candidates) {
+                for (const auto& c : candidates) {
+                    merged.offer(slot, queries.size(), topR, std::get<0>(c), std::get<1>(c), std::get<2>(c));
+                }
+            });
+        }
+        barrier.wait();
+
+        merged.forEachSlot(husky::Context::get_local_tid(), husky::Context::get_num_local_workers(),
+            [&](int slot, const std::vector<typename BufferType::Candidate>& candidates) {
+            const auto& queryVector = queries.getVector(slot);
+            for (const auto& c : candidates) {
+                fn(queries.getId(slot), std::get<1>(c), factory.calDist(queryVector, std::get<2>(c)));
+            }
+        });
+        // nobody merges the next iteration before the buffer is empty
+        barrier.wait([] { merged.clear(); });
+    }
+
+    Span<const uint8_t> _pqCode;
+    ItemAttributes _attrs;
 };
 
 template<typename ItemIdType,
          typename ItemElementType,
          typename QueryMsg,
-         typename AnswerMsg >
+         typename AnswerMsg,
+         typename FactoryType>
 thread_local std::vector<std::pair<ItemIdType, AnswerMsg>> LSHItem<ItemIdType,
     ItemElementType,
     QueryMsg,
-    AnswerMsg>::item_msg_buffer;
+    AnswerMsg,
+    FactoryType>::item_msg_buffer;
 
 template<typename ItemIdType,
          typename ItemElementType,
          typename QueryMsg,
-         typename AnswerMsg >
+         typename AnswerMsg,
+         typename FactoryType>
 thread_local std::unordered_map<ItemIdType, std::vector<AnswerMsg>> LSHItem<ItemIdType,
     ItemElementType,
     QueryMsg,
-    AnswerMsg>::topk_item_msg_buffer;
+    AnswerMsg,
+    FactoryType>::topk_item_msg_buffer;
+
+template<typename ItemIdType,
+         typename ItemElementType,
+         typename QueryMsg,
+         typename AnswerMsg,
+         typename FactoryType>
+thread_local std::vector<ItemIdType> LSHItem<ItemIdType,
+    ItemElementType,
+    QueryMsg,
+    AnswerMsg,
+    FactoryType>::batch_query_ids;
+
+template<typename ItemIdType,
+         typename ItemElementType,
+         typename QueryMsg,
+         typename AnswerMsg,
+         typename FactoryType>
+thread_local std::vector<float> LSHItem<ItemIdType,
+    ItemElementType,
+    QueryMsg,
+    AnswerMsg,
+    FactoryType>::batch_dists;
 
 } // namespace losha
 } // namespace husky
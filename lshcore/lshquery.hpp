@@ -23,6 +23,7 @@
 #include "base/log.hpp"
 #include "core/engine.hpp"
 
+#include "bucketkey.hpp"
 #include "densevector.hpp"
 #include "lshfactory.hpp"
 #include "lshutils.hpp"
@@ -34,12 +35,13 @@ namespace losha {
 template<typename ItemIdType,
     typename ItemElementType,
     typename QueryMsg = DenseVector<ItemIdType, ItemElementType>,
-    typename AnswerMsg = std::pair<ItemIdType, float> >
+    typename AnswerMsg = std::pair<ItemIdType, float>,
+    typename FactoryType = LSHFactory<ItemIdType, ItemElementType>>
 class LSHQuery: public DenseVector<ItemIdType, ItemElementType> {
     public:
 
         // to store buckets, for each bucket, we will send the query
-        static thread_local std::vector<  std::vector<int> > query_msg_buffer;
+        static thread_local std::vector<BucketKey> query_msg_buffer;
         bool needBroadcast = false;
         bool finished = false;
 
@@ -52,19 +54,27 @@ class LSHQuery: public DenseVector<ItemIdType, ItemElementType> {
             return this->getItem();
         }
 
-        // bId must contain table Idx as the last element
-        inline void sendToBucket(const std::vector<int>& bId) {
+        inline void sendToBucket(const BucketKey& bId) {
             query_msg_buffer.emplace_back(bId);
         }
 
         // sig cannot contain table Idx
-        inline void sendToBucket(std::vector<int> sig, int tableIdx) {
-            sig.push_back(tableIdx);
-            query_msg_buffer.emplace_back(sig);
+        inline void sendToBucket(const std::vector<int>& sig, int tableIdx) {
+            query_msg_buffer.emplace_back(sig.data(), sig.size(), tableIdx);
+        }
+
+        // send to the bucket of every table, keys are written straight into
+        // query_msg_buffer
+        inline void sendToBuckets(
+            const FactoryType& factory,
+            const ItemVector<ItemElementType>& itemVector) {
+            size_t offset = query_msg_buffer.size();
+            query_msg_buffer.resize(offset + factory.getNumTables());
+            factory.calBucketsInto(itemVector, query_msg_buffer.data() + offset);
         }
 
         virtual void query(
-            LSHFactory<ItemIdType, ItemElementType>& factory,
+            FactoryType& factory,
             const vector<AnswerMsg>& inMsg) = 0;
 
         void broadcast() {
@@ -77,9 +87,9 @@ class LSHQuery: public DenseVector<ItemIdType, ItemElementType> {
 };
 
 template<typename ItemIdType, typename ItemElementType,
-    typename QueryMsg, typename AnswerMsg>
-thread_local std::vector<std::vector<int>>
-    LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg>::query_msg_buffer;
+    typename QueryMsg, typename AnswerMsg, typename FactoryType>
+thread_local std::vector<BucketKey>
+    LSHQuery<ItemIdType, ItemElementType, QueryMsg, AnswerMsg, FactoryType>::query_msg_buffer;
 
 } // namespace losha
 } // namespace husky
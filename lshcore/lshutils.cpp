@@ -33,6 +33,19 @@ void normalize(std::vector<std::pair<int, float> > &vec) {
     }
 }
 
+void normalize(SparseVector<float> &vec) {
+    assert(vec.size() != 0);
+    float sum = 0;
+    for (size_t i = 0; i < vec.size(); ++i) {
+        sum += vec.value(i) * vec.value(i);
+    }
+    sum = sqrt(sum);
+    assert(fabs(sum - 0) > 0.0000000001);
+    for (size_t i = 0; i < vec.size(); ++i) {
+        vec.value(i) /= sum;
+    }
+}
+
 std::pair<unsigned, float> lshStoPair(const std::string& pairStr) {
     int splitter = pairStr.find(':');
     unsigned index = std::stoul(pairStr.substr(0, splitter));
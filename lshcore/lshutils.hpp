@@ -23,6 +23,8 @@
 
 #include "boost/functional/hash.hpp"
 
+#include "losha/common/sparsevector.hpp"
+
 namespace husky {
 namespace losha {
 
@@ -30,8 +32,12 @@ void normalize(std::vector<float> &vec);
 
 void normalize(std::vector<std::pair<int, float> > &vec); 
 
+void normalize(SparseVector<float> &vec);
+
 std::pair<int, float> lshStofPair(const std::string& pairStr);
 
+std::pair<unsigned, float> lshStoPair(const std::string& pairStr);
+
 } // namespace losha
 } // namespace husky
 
@@ -54,6 +60,16 @@ std::string to_string(const std::vector<T>& v) {
     return str;
 }
 
+template<typename T>
+std::string to_string(const husky::losha::SparseVector<T>& v) {
+    std::string str = "<";
+    for (size_t i = 0; i < v.size(); ++i) {
+        str += std::to_string(v.index(i)) + ":" + std::to_string(v.value(i)) + " ";
+    }
+    str += ">";
+    return str;
+}
+
 template<typename T>
 std::string to_string(const std::vector< std::vector<T> >& matrix) {
     std::string str = "\n\n[";
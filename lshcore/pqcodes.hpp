@@ -0,0 +1,270 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <tuple>
+#include <vector>
+
+#include "base/log.hpp"
+
+#include "losha/common/span.hpp"
+
+namespace husky {
+namespace losha {
+
+/*
+ * Product quantizer for the re-ranking stage: the dimensions are cut into
+ * numSubspaces consecutive subspaces and every subvector is coded by the
+ * nearest of at most 256 k-means centroids, one byte per subspace.
+ * Candidates are scored against a query with asymmetric distances: the sum
+ * of per subspace lookups into tables of squared distances from the query
+ * subvectors to all centroids, built once per query. Only squared Euclidean
+ * distances are approximated.
+ * */
+class ProductQuantizer {
+public:
+    static const int kCentroids = 256;
+
+    // k-means on the rows of samples (dimension floats each), deterministic for a seed
+    void train(const std::vector<float>& samples, int dimension, int numSubspaces,
+            int numIterations = 10, unsigned seed = 0) {
+        ASSERT_MSG(numSubspaces > 0 && numSubspaces <= dimension, "invalid number of PQ subspaces");
+        size_t numSamples = samples.size() / dimension;
+        ASSERT_MSG(numSamples > 0, "no PQ training samples");
+        _dimension = dimension;
+        _numSubspaces = numSubspaces;
+        _numCentroids = std::min<size_t>(kCentroids, numSamples);
+        _offsets.resize(numSubspaces + 1);
+        for (int m = 0; m <= numSubspaces; ++m) {
+            _offsets[m] = dimension * m / numSubspaces;
+        }
+        _centroids.assign(static_cast<size_t>(_numCentroids) * dimension, 0);
+
+        // initial centroids are distinct random samples
+        std::vector<size_t> order(numSamples);
+        for (size_t i = 0; i < numSamples; ++i) order[i] = i;
+        std::mt19937 gen(seed);
+        std::shuffle(order.begin(), order.end(), gen);
+        for (int c = 0; c < _numCentroids; ++c) {
+            std::copy(&samples[order[c] * dimension], &samples[order[c] * dimension] + dimension,
+                &_centroids[static_cast<size_t>(c) * dimension]);
+        }
+
+        std::vector<int> assignment(numSamples);
+        std::vector<double> sums;
+        std::vector<int> counts;
+        for (int m = 0; m < numSubspaces; ++m) {
+            int begin = _offsets[m], width = _offsets[m + 1] - begin;
+            for (int iter = 0; iter < numIterations; ++iter) {
+                for (size_t i = 0; i < numSamples; ++i) {
+                    assignment[i] = nearest(m, &samples[i * dimension + begin]);
+                }
+                sums.assign(static_cast<size_t>(_numCentroids) * width, 0);
+                counts.assign(_numCentroids, 0);
+                for (size_t i = 0; i < numSamples; ++i) {
+                    double* sum = &sums[static_cast<size_t>(assignment[i]) * width];
+                    for (int j = 0; j < width; ++j) sum[j] += samples[i * dimension + begin + j];
+                    ++counts[assignment[i]];
+                }
+                // empty clusters keep their centroid
+                for (int c = 0; c < _numCentroids; ++c) {
+                    if (counts[c] == 0) continue;
+                    float* centroid = subCentroid(m, c);
+                    for (int j = 0; j < width; ++j) {
+                        centroid[j] = sums[static_cast<size_t>(c) * width + j] / counts[c];
+                    }
+                }
+            }
+        }
+    }
+
+    inline bool enabled() const { return _numSubspaces != 0; }
+    inline int getNumSubspaces() const { return _numSubspaces; }
+    inline int getDimension() const { return _dimension; }
+
+    template<typename T>
+    void encode(Span<const T> v, uint8_t* code) const {
+        ASSERT_MSG(v.size() == _dimension, "PQ dimension mismatch");
+        static thread_local std::vector<float> x;
+        x.assign(v.data(), v.data() + v.size());
+        for (int m = 0; m < _numSubspaces; ++m) {
+            code[m] = nearest(m, &x[_offsets[m]]);
+        }
+    }
+
+    template<typename T>
+    void encode(SparseSpan<T> v, uint8_t* code) const {
+        ASSERT_MSG(false, "PQ codes need dense features");
+    }
+
+    // numSubspaces x kCentroids squared distances from the subvectors of v
+    template<typename T>
+    void buildTable(Span<const T> v, float* table) const {
+        ASSERT_MSG(v.size() == _dimension, "PQ dimension mismatch");
+        for (int m = 0; m < _numSubspaces; ++m) {
+            int begin = _offsets[m], width = _offsets[m + 1] - begin;
+            float* row = table + static_cast<size_t>(m) * kCentroids;
+            for (int c = 0; c < _numCentroids; ++c) {
+                const float* centroid = subCentroid(m, c);
+                float dist = 0;
+                for (int j = 0; j < width; ++j) {
+                    float diff = static_cast<float>(v[begin + j]) - centroid[j];
+                    dist += diff * diff;
+                }
+                row[c] = dist;
+            }
+            std::fill(row + _numCentroids, row + kCentroids, std::numeric_limits<float>::max());
+        }
+    }
+
+    template<typename T>
+    void buildTable(SparseSpan<T> v, float* table) const {
+        ASSERT_MSG(false, "PQ codes need dense features");
+    }
+
+    inline float adcDist(const float* table, const uint8_t* code) const {
+        float dist = 0;
+        for (int m = 0; m < _numSubspaces; ++m) {
+            dist += table[m * kCentroids + code[m]];
+        }
+        return dist;
+    }
+
+private:
+    inline float* subCentroid(int m, int c) {
+        return &_centroids[static_cast<size_t>(c) * _dimension + _offsets[m]];
+    }
+    inline const float* subCentroid(int m, int c) const {
+        return &_centroids[static_cast<size_t>(c) * _dimension + _offsets[m]];
+    }
+
+    int nearest(int m, const float* x) const {
+        int width = _offsets[m + 1] - _offsets[m];
+        int best = 0;
+        float bestDist = std::numeric_limits<float>::max();
+        for (int c = 0; c < _numCentroids; ++c) {
+            const float* centroid = subCentroid(m, c);
+            float dist = 0;
+            for (int j = 0; j < width; ++j) {
+                float diff = x[j] - centroid[j];
+                dist += diff * diff;
+            }
+            if (dist < bestDist) {
+                bestDist = dist;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    int _dimension = 0;
+    int _numSubspaces = 0;
+    int _numCentroids = 0;
+    std::vector<int> _offsets;
+    // centroid c of subspace m is _centroids[c * dimension + offsets[m], c * dimension + offsets[m + 1])
+    std::vector<float> _centroids;
+};
+
+/*
+ * Two-stage verification: candidates are first scored with the asymmetric
+ * distances of their PQ codes, only the topR best of every query in every
+ * process get an exact distance. Per query lookup tables are built with the
+ * broadcast queries.
+ * */
+class PQReranker {
+public:
+    void initialize(int topR) {
+        _topR = topR;
+    }
+
+    inline bool enabled() const { return _topR > 0 && _pq.enabled(); }
+    inline int getTopR() const { return _topR; }
+    inline ProductQuantizer& getQuantizer() { return _pq; }
+    inline const ProductQuantizer& getQuantizer() const { return _pq; }
+
+    template<typename QueryStoreT>
+    void build(const QueryStoreT& queries) {
+        if (!enabled()) return;
+        size_t tableSize = static_cast<size_t>(_pq.getNumSubspaces()) * ProductQuantizer::kCentroids;
+        _tables.resize(queries.size() * tableSize);
+        for (int slot = 0; slot < queries.size(); ++slot) {
+            _pq.buildTable(queries.getVector(slot), &_tables[slot * tableSize]);
+        }
+    }
+
+    inline float adcDist(int slot, const uint8_t* code) const {
+        return _pq.adcDist(&_tables[static_cast<size_t>(slot) * _pq.getNumSubspaces() * ProductQuantizer::kCentroids], code);
+    }
+
+private:
+    int _topR = 0;
+    ProductQuantizer _pq;
+    std::vector<float> _tables;
+};
+
+/*
+ * Candidates of the first stage: a max-heap of at most topR
+ * (approximate distance, item id, item span) per query slot. Each thread
+ * fills its own, which is merged into the one of the process once per
+ * iteration and then split by slot over the local workers.
+ * */
+template<typename ItemIdType, typename SpanT>
+class RerankBuffer {
+public:
+    typedef std::tuple<float, ItemIdType, SpanT> Candidate;
+
+    static RerankBuffer& local() {
+        static thread_local RerankBuffer buffer;
+        return buffer;
+    }
+
+    inline void offer(int slot, int numSlots, int topR, float approxDist, const ItemIdType& itemId, SpanT span) {
+        if (_heaps.size() != numSlots) _heaps.resize(numSlots);
+        auto& heap = _heaps[slot];
+        if (heap.empty()) _touched.push_back(slot);
+        if (heap.size() == topR) {
+            if (!(approxDist < std::get<0>(heap.front()))) return;
+            std::pop_heap(heap.begin(), heap.end(), less);
+            heap.pop_back();
+        }
+        heap.emplace_back(approxDist, itemId, span);
+        std::push_heap(heap.begin(), heap.end(), less);
+    }
+
+    // fn(slot, candidates) for every query slot with candidates, then clears
+    template<typename FnT>
+    void drain(FnT fn) {
+        for (int slot : _touched) {
+            fn(slot, _heaps[slot]);
+            _heaps[slot].clear();
+        }
+        _touched.clear();
+    }
+
+    // fn(slot, candidates) for every stride-th slot with candidates from first on
+    template<typename FnT>
+    void forEachSlot(int first, int stride, FnT fn) const {
+        for (size_t i = first; i < _touched.size(); i += stride) {
+            fn(_touched[i], _heaps[_touched[i]]);
+        }
+    }
+
+    void clear() {
+        for (int slot : _touched) {
+            _heaps[slot].clear();
+        }
+        _touched.clear();
+    }
+
+private:
+    static bool less(const Candidate& a, const Candidate& b) {
+        return std::get<0>(a) < std::get<0>(b);
+    }
+
+    std::vector<std::vector<Candidate>> _heaps;
+    std::vector<int> _touched;
+};
+
+} // namespace losha
+} // namespace husky
@@ -0,0 +1,76 @@
+#pragma once
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "bucketkey.hpp"
+
+namespace husky {
+namespace losha {
+
+/*
+ * Per query candidate budget (probeBudget). Instead of going straight to
+ * its buckets, a query first asks them for their sizes. It then spends its
+ * remaining budget on them smallest bucket first, and a bucket larger than
+ * its quota forwards an evenly strided, deterministic subset of its items.
+ * The budget holds over all iterations of the query. State lives on the
+ * thread that owns the query.
+ * */
+template<typename ItemIdType, typename QueryMsg>
+class ProbeBudget {
+public:
+    static ProbeBudget& local() {
+        static thread_local ProbeBudget budget;
+        return budget;
+    }
+
+    // keep the message the query sends this iteration, the budget starts full
+    void request(const ItemIdType& queryId, const QueryMsg& msg, size_t budget) {
+        auto it = _queries.find(queryId);
+        if (it == _queries.end()) {
+            _queries.emplace(queryId, std::make_pair(msg, budget));
+        } else {
+            it->second.first = msg;
+        }
+    }
+
+    // sizes: (bucket, number of items) of the buckets the query asked,
+    // fn(msg, bucket, quota) for the ones it can afford, smallest first
+    template<typename FnT>
+    void allot(const ItemIdType& queryId, std::vector<std::pair<BucketKey, int>>& sizes, FnT fn) {
+        auto it = _queries.find(queryId);
+        if (it == _queries.end()) return;
+        std::sort(sizes.begin(), sizes.end(),
+            [](const std::pair<BucketKey, int>& a, const std::pair<BucketKey, int>& b) {
+            return a.second < b.second || (a.second == b.second && a.first < b.first);
+        });
+        size_t& remaining = it->second.second;
+        for (const auto& s : sizes) {
+            if (remaining == 0) break;
+            if (s.second == 0) continue;
+            int quota = std::min<size_t>(s.second, remaining);
+            fn(it->second.first, s.first, quota);
+            remaining -= quota;
+        }
+    }
+
+    // indices of the quota items a bucket of size items forwards
+    template<typename FnT>
+    static void sample(size_t size, size_t quota, FnT fn) {
+        if (quota >= size) {
+            for (size_t i = 0; i < size; ++i) fn(i);
+            return;
+        }
+        for (size_t j = 0; j < quota; ++j) {
+            fn(j * size / quota);
+        }
+    }
+
+private:
+    // query id -> (message of this iteration, remaining budget)
+    std::unordered_map<ItemIdType, std::pair<QueryMsg, size_t>> _queries;
+};
+
+} // namespace losha
+} // namespace husky
@@ -0,0 +1,180 @@
+/*
+ * Copyright 2016 Husky Team
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <cmath>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "base/log.hpp"
+
+#include "losha/common/algebra.hpp"
+#include "losha/common/span.hpp"
+#include "losha/common/sparsevector.hpp"
+
+namespace husky {
+namespace losha {
+
+/*
+ * Remaps query ids to dense slots. Ids that are small non-negative integers
+ * (at most kDirectRatio times the number of queries) index a flat array,
+ * other ids go through a hash map.
+ * */
+template<typename ItemIdType>
+class QuerySlotMap {
+public:
+    static const size_t kDirectRatio = 4;
+
+    void build(const std::vector<ItemIdType>& ids) {
+        _direct.clear();
+        _hashed.clear();
+        buildImpl(ids, std::is_integral<ItemIdType>());
+    }
+
+    // -1 if qid was not broadcast
+    inline int find(const ItemIdType& qid) const {
+        return findImpl(qid, std::is_integral<ItemIdType>());
+    }
+
+private:
+    void buildImpl(const std::vector<ItemIdType>& ids, std::true_type) {
+        bool direct = true;
+        long long maxId = -1;
+        for (const auto& id : ids) {
+            if (id < 0) { direct = false; break; }
+            if (static_cast<long long>(id) > maxId) maxId = id;
+        }
+        if (direct && maxId < static_cast<long long>(kDirectRatio * ids.size() + 1024)) {
+            _direct.assign(maxId + 1, -1);
+            for (int slot = 0; slot < ids.size(); ++slot) {
+                ASSERT_MSG(_direct[ids[slot]] == -1, "query already exists");
+                _direct[ids[slot]] = slot;
+            }
+            return;
+        }
+        buildImpl(ids, std::false_type());
+    }
+
+    void buildImpl(const std::vector<ItemIdType>& ids, std::false_type) {
+        _hashed.reserve(ids.size());
+        for (int slot = 0; slot < ids.size(); ++slot) {
+            bool inserted = _hashed.emplace(ids[slot], slot).second;
+            ASSERT_MSG(inserted, "query already exists");
+        }
+    }
+
+    inline int findImpl(const ItemIdType& qid, std::true_type) const {
+        if (!_direct.empty()) {
+            if (qid < 0 || qid >= static_cast<ItemIdType>(_direct.size())) return -1;
+            return _direct[qid];
+        }
+        return findImpl(qid, std::false_type());
+    }
+
+    inline int findImpl(const ItemIdType& qid, std::false_type) const {
+        auto it = _hashed.find(qid);
+        return it == _hashed.end() ? -1 : it->second;
+    }
+
+    std::vector<int> _direct;
+    std::unordered_map<ItemIdType, int> _hashed;
+};
+
+/*
+ * Broadcast queries of a worker: one contiguous matrix of all query vectors
+ * (CSR for sparse queries), their ids and L2 norms, addressed by dense slot.
+ * Filled with add() and finalize() once, read-only afterwards, so any number
+ * of threads can read it concurrently.
+ * */
+template<typename Derived, typename ItemIdType>
+class QueryStoreBase {
+public:
+    // remap ids to slots and compute the norms, call once after the last add()
+    void finalize() {
+        _slots.build(_ids);
+        _norms.resize(_ids.size());
+        const Derived& self = static_cast<const Derived&>(*this);
+        for (int slot = 0; slot < _ids.size(); ++slot) {
+            _norms[slot] = calL2Norm(self.getVector(slot));
+        }
+    }
+
+    inline int getSlot(const ItemIdType& qid) const {
+        int slot = _slots.find(qid);
+        ASSERT_MSG(slot != -1, "cannot find query");
+        return slot;
+    }
+
+    inline const ItemIdType& getId(int slot) const { return _ids[slot]; }
+    inline float getNorm(int slot) const { return _norms[slot]; }
+    inline const float* getNorms() const { return _norms.data(); }
+    inline int size() const { return _ids.size(); }
+    inline bool empty() const { return _ids.empty(); }
+
+protected:
+    std::vector<ItemIdType> _ids;
+    std::vector<float> _norms;
+    QuerySlotMap<ItemIdType> _slots;
+};
+
+template<typename ItemIdType, typename ItemElementType>
+class QueryStore : public QueryStoreBase<QueryStore<ItemIdType, ItemElementType>, ItemIdType> {
+public:
+    void add(const ItemIdType& qid, const std::vector<ItemElementType>& v) {
+        if (this->_ids.empty()) {
+            _dimension = v.size();
+        }
+        ASSERT_MSG(v.size() == _dimension, "queries must have the same dimension");
+        this->_ids.push_back(qid);
+        _matrix.insert(_matrix.end(), v.begin(), v.end());
+    }
+
+    inline Span<const ItemElementType> getVector(int slot) const {
+        return Span<const ItemElementType>(_matrix.data() + slot * _dimension, _dimension);
+    }
+
+private:
+    size_t _dimension = 0;
+    std::vector<ItemElementType> _matrix;
+};
+
+template<typename ItemIdType, typename T>
+class QueryStore<ItemIdType, std::pair<int, T>>
+    : public QueryStoreBase<QueryStore<ItemIdType, std::pair<int, T>>, ItemIdType> {
+public:
+    void add(const ItemIdType& qid, const SparseVector<T>& v) {
+        this->_ids.push_back(qid);
+        _indices.insert(_indices.end(), v._indices.begin(), v._indices.end());
+        _values.insert(_values.end(), v._values.begin(), v._values.end());
+        _offsets.push_back(_values.size());
+    }
+
+    inline SparseSpan<T> getVector(int slot) const {
+        size_t begin = _offsets[slot];
+        return SparseSpan<T>(_indices.data() + begin, _values.data() + begin,
+            _offsets[slot + 1] - begin);
+    }
+
+private:
+    std::vector<size_t> _offsets = std::vector<size_t>(1, 0);
+    std::vector<int> _indices;
+    std::vector<T> _values;
+};
+
+} // namespace losha
+} // namespace husky
@@ -0,0 +1,199 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "base/log.hpp"
+
+#include "losha/common/span.hpp"
+
+namespace husky {
+namespace losha {
+
+/*
+ * 64-bit SimHash sketches: the signs of 64 Gaussian projections, so the
+ * fraction of differing bits of two sketches estimates angle / pi. Dense
+ * vectors are projected with a dimension x 64 matrix. Sparse ones draw the
+ * Gaussians of a feature from a hash of (seed, feature), so that millions of
+ * sparse dimensions need no matrix; initialize sparse sketchers with
+ * denseDimension 0.
+ * */
+class SimHashSketcher {
+public:
+    static const int kBits = 64;
+
+    void initialize(int denseDimension, uint64_t seed) {
+        _seed = seed;
+        std::default_random_engine generator(seed);
+        std::normal_distribution<float> distribution(0.0, 1.0);
+        _matrix.resize(static_cast<size_t>(denseDimension) * kBits);
+        for (auto& e : _matrix) {
+            e = distribution(generator);
+        }
+    }
+
+    template<typename T>
+    uint64_t sketch(Span<const T> v) const {
+        ASSERT_MSG(v.size() * kBits <= _matrix.size(), "vector is longer than the sketch dimension");
+        float acc[kBits] = {0};
+        for (size_t j = 0; j < v.size(); ++j) {
+            float x = v[j];
+            const float* row = _matrix.data() + j * kBits;
+            for (int b = 0; b < kBits; ++b) {
+                acc[b] += x * row[b];
+            }
+        }
+        return toBits(acc);
+    }
+
+    template<typename T>
+    uint64_t sketch(SparseSpan<T> v) const {
+        float acc[kBits] = {0};
+        float g[kBits];
+        for (size_t i = 0; i < v.size(); ++i) {
+            gaussians(v.indices()[i], g);
+            float x = v.values()[i];
+            for (int b = 0; b < kBits; ++b) {
+                acc[b] += x * g[b];
+            }
+        }
+        return toBits(acc);
+    }
+
+    static inline int hamming(uint64_t a, uint64_t b) {
+        return __builtin_popcountll(a ^ b);
+    }
+
+private:
+    static uint64_t toBits(const float* acc) {
+        uint64_t bits = 0;
+        for (int b = 0; b < kBits; ++b) {
+            bits |= static_cast<uint64_t>(acc[b] >= 0) << b;
+        }
+        return bits;
+    }
+
+    // splitmix64
+    static inline uint64_t mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    // the kBits Gaussians of a sparse feature, Box-Muller on hashed uniforms
+    void gaussians(int feature, float* out) const {
+        uint64_t state = mix(_seed ^ (static_cast<uint64_t>(feature) << 8));
+        for (int b = 0; b < kBits; b += 2) {
+            state = mix(state);
+            // two 32-bit uniforms in (0, 1]
+            double u1 = ((state >> 32) + 1.0) / 4294967296.0;
+            double u2 = ((state & 0xffffffffULL) + 1.0) / 4294967296.0;
+            double r = sqrt(-2.0 * log(u1));
+            out[b] = r * cos(2 * M_PI * u2);
+            out[b + 1] = r * sin(2 * M_PI * u2);
+        }
+    }
+
+    uint64_t _seed = 0;
+    std::vector<float> _matrix;
+};
+
+/*
+ * r-near-neighbour mode: items report the queries within a radius of the
+ * factory's distance. The radius is global, or set per query before the
+ * queries are finished. With the sketch prefilter, which is only sound when
+ * the distance is the angle between vectors, buckets keep the sketches of
+ * their items and do not forward a query to the items whose sketches differ
+ * from its own in more bits than an angle of radius would give with
+ * probability Phi(-confidence).
+ * */
+template<typename ItemIdType>
+class RadiusFilter {
+public:
+    // denseDimension is 0 for sparse vectors
+    void initialize(float radius, bool sketch, int denseDimension, float confidence = 3, uint64_t seed = 0) {
+        _enabled = true;
+        _radius = radius;
+        _sketch = sketch;
+        _confidence = confidence;
+        if (sketch) {
+            _sketcher.initialize(denseDimension, seed);
+        }
+    }
+
+    // per query override of the global radius, before build()
+    void setQueryRadius(const ItemIdType& qid, float radius) {
+        _queryRadius[qid] = radius;
+    }
+
+    // radii and sketches of the broadcast queries by slot
+    template<typename QueryStoreT>
+    void build(const QueryStoreT& queries) {
+        if (!_enabled) return;
+        _radii.resize(queries.size());
+        _maxHamming.resize(queries.size());
+        _querySketches.resize(queries.size());
+        for (int slot = 0; slot < queries.size(); ++slot) {
+            auto it = _queryRadius.find(queries.getId(slot));
+            _radii[slot] = it == _queryRadius.end() ? _radius : it->second;
+            if (_sketch) {
+                _querySketches[slot] = _sketcher.sketch(queries.getVector(slot));
+                _maxHamming[slot] = maxHamming(_radii[slot], _confidence);
+            }
+        }
+    }
+
+    inline bool enabled() const { return _enabled; }
+    inline bool sketchEnabled() const { return _sketch; }
+    inline float getRadius(int slot) const { return _radii[slot]; }
+
+    template<typename SpanT>
+    inline uint64_t sketch(SpanT v) const {
+        return _sketcher.sketch(v);
+    }
+
+    // true if the item is too far from the query in slot by its sketch
+    inline bool rejects(int slot, uint64_t itemSketch) const {
+        return SimHashSketcher::hamming(_querySketches[slot], itemSketch) > _maxHamming[slot];
+    }
+
+    // radius of an id taken as a query without the query store, as in self-joins
+    inline float getRadiusOf(const ItemIdType& id) const {
+        auto it = _queryRadius.find(id);
+        return it == _queryRadius.end() ? _radius : it->second;
+    }
+
+    // true if two sketches are too far apart for radius
+    inline bool rejects(uint64_t sketch, uint64_t otherSketch, float radius) const {
+        return SimHashSketcher::hamming(sketch, otherSketch) > maxHamming(radius, _confidence);
+    }
+
+    // Hamming distance that an angle of radius stays below with the given confidence,
+    // normal approximation of Binomial(kBits, radius / pi)
+    static int maxHamming(float radius, float confidence) {
+        const int n = SimHashSketcher::kBits;
+        double p = radius / M_PI;
+        if (p >= 1) return n;
+        if (p < 0) p = 0;
+        double bound = n * p + confidence * sqrt(n * p * (1 - p));
+        return std::min(n, static_cast<int>(ceil(bound)));
+    }
+
+private:
+    bool _enabled = false;
+    bool _sketch = false;
+    float _radius = 0;
+    float _confidence = 3;
+    SimHashSketcher _sketcher;
+    std::unordered_map<ItemIdType, float> _queryRadius;
+    std::vector<float> _radii;
+    std::vector<int> _maxHamming;
+    std::vector<uint64_t> _querySketches;
+};
+
+} // namespace losha
+} // namespace husky
@@ -5,6 +5,8 @@ numThreads=4;
 metric="angular"
 queryType="topk:20"
 # queryType="radius:0.9"
+# inverted: inverted index over the item features, merge: query against every item
+method="inverted"
 
 iter=0
 for dataset in "tweet"
@@ -31,5 +33,5 @@ do
     fi
 
 
-    tmp/cal_groundtruth_idlibsvm $base_file $query_file $queryType $lshbox_bench_file $metric $numThreads
+    tmp/cal_groundtruth_idlibsvm $base_file $query_file $queryType $lshbox_bench_file $metric $numThreads $method
 done
@@ -1,3 +1,5 @@
+# tools/vecs_to_idvecs does the same conversion natively and in parallel
+
 dataset = "audio"
 base_fvecs_file = "../gqr/data/" + dataset + "/" + dataset + "_base" + ".fvecs"
 base_output_file = dataset + "_base" + ".idfvecs"
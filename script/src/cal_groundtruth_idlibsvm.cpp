@@ -4,6 +4,7 @@
 #include <vector>
 #include <string>
 #include <utility>
+#include <thread>
 
 #include "gqr/util/cal_groundtruth.h"
 #include "lshcore/lshutils.cpp"
@@ -29,8 +30,14 @@ void evaluate(
     int itemStartIdx = 0;
     vector<vector<pair<int, float>>> items;
     items.reserve(itemBatchSize);
+    bool binary = isIdSvecsPath(baseFileName);
+    IdSvecsReader baseReader(baseFin);
     while (true) {
-        readIdLIBSVM(items, baseFin, itemBatchSize);
+        if (binary) {
+            readIdSvecs(items, baseReader, itemBatchSize);
+        } else {
+            readIdLIBSVM(items, baseFin, itemBatchSize);
+        }
         if (items.size() == 0) {
             break;
         }
@@ -44,6 +51,95 @@ void evaluate(
     baseFin.close();
 }
 
+/*
+ * Angular ground truth through an inverted index per item batch: a query only
+ * pays for the posting lists of its features. Each thread keeps its own dense
+ * accumulator over the batch and handles every numThreads-th query, so the
+ * query objects need no locking. QueryType needs offer(itemId, distance) and
+ * needsOrthogonalItems().
+ * */
+template<typename QueryType>
+void inverted_evaluate(
+    std::vector<QueryType>& queryObjs,
+    std::vector<std::vector<pair<int, float>>> queryVecs,
+    const char* baseFileName,
+    int numThreads = 4,
+    int itemBatchSize = 200000) {
+
+    vector<float> queryNorms;
+    for (auto& query : queryVecs) {
+        std::sort(query.begin(), query.end());
+        queryNorms.push_back(calL2Norm(query));
+    }
+
+    ifstream baseFin(baseFileName, ios::binary);
+    if (!baseFin) {
+        cout << "base File " << baseFileName << " does not exist" << endl;
+        assert(false);
+    }
+    int itemStartIdx = 0;
+    vector<vector<pair<int, float>>> items;
+    items.reserve(itemBatchSize);
+    bool binary = isIdSvecsPath(baseFileName);
+    IdSvecsReader baseReader(baseFin);
+    SparseInvertedIndex index;
+    while (true) {
+        if (binary) {
+            readIdSvecs(items, baseReader, itemBatchSize);
+        } else {
+            readIdLIBSVM(items, baseFin, itemBatchSize);
+        }
+        if (items.size() == 0) {
+            break;
+        }
+        index.build(items, itemStartIdx);
+
+        auto worker = [&](int tid) {
+            vector<float> dots(index.size(), 0);
+            vector<char> seen(index.size(), 0);
+            vector<int> touched;
+            for (int q = tid; q < queryObjs.size(); q += numThreads) {
+                index.accumulate(queryVecs[q], dots, seen, touched);
+                for (int i : touched) {
+                    float product = dots[i];
+                    if (product != 0) {
+                        product /= queryNorms[q];
+                        product /= index.getNorm(i);
+                    }
+                    product = std::max(-1.0f, std::min(1.0f, product));
+                    queryObjs[q].offer(index.getId(i), acos(product));
+                }
+                for (int i = 0; i < index.size() && queryObjs[q].needsOrthogonalItems(); ++i) {
+                    if (!seen[i]) {
+                        queryObjs[q].offer(index.getId(i), kOrthogonalDist);
+                    }
+                }
+                for (int i : touched) {
+                    dots[i] = 0;
+                    seen[i] = 0;
+                }
+                touched.clear();
+            }
+        };
+        vector<std::thread> threads;
+        for (int t = 0; t < numThreads; ++t) {
+            threads.emplace_back(worker, t);
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        itemStartIdx += items.size();
+        cout << itemStartIdx << " items have been evaluated" << endl;
+        items.clear();
+    }
+
+    baseFin.close();
+    for (auto& query : queryObjs) {
+        query.sortResults();
+    }
+}
+
 template<typename FeatureType>
 vector<GTQuery<FeatureType>> topk_evaluate(
     const std::vector<std::vector<FeatureType>>& queryVecs,
@@ -98,8 +194,9 @@ vector<RadiusQuery<FeatureType>> radius_evaluate(
 }
 
 int main(int argc, char** argv) {
-    if (argc != 6 && argc != 7) {
-        cout << "usage: program base_file.idlibsvm query_file.idlibsvm K groundtruth_file.lshbox groundtruth_file.ivecs num_threads=4" << endl;
+    if (argc < 6 || argc > 8) {
+        cout << "usage: program base_file.idlibsvm query_file.idlibsvm K groundtruth_file.lshbox groundtruth_file.ivecs num_threads=4 method=inverted|merge" << endl;
+        cout << "base and query files can also be .idsvecs" << endl;
         return 0;
     }
 
@@ -111,9 +208,22 @@ int main(int argc, char** argv) {
     int numThreads = 4;
     if (argc >= 7)
         numThreads = stoi(argv[6]);
+    // inverted: inverted index over the item features, angular only
+    // merge: every query against every item
+    string method = "inverted";
+    if (argc >= 8)
+        method = argv[7];
+    if (method != "inverted" && method != "merge") {
+        cout << "unknown method " << method << ", use inverted or merge" << endl;
+        return 0;
+    }
+    if (method == "inverted" && metric != "angular") {
+        cout << "the inverted method only supports the angular metric" << endl;
+        return 0;
+    }
 
 
-    ifstream queryFin(queryFileName);
+    ifstream queryFin(queryFileName, ios::binary);
     if (!queryFin) {
         cout << "query File "  << queryFileName << " does not exist "<< endl;
         return 0;
@@ -121,10 +231,30 @@ int main(int argc, char** argv) {
 
     typedef pair<int, float> FeatureType;
     vector<vector<FeatureType>> queryVecs;
-    readIdLIBSVM(queryVecs, queryFin);
+    if (isIdSvecsPath(queryFileName)) {
+        IdSvecsReader queryReader(queryFin);
+        readIdSvecs(queryVecs, queryReader);
+    } else {
+        readIdLIBSVM(queryVecs, queryFin);
+    }
     queryFin.close();
 
-    if (queryType.find("topk") != string::npos) {
+    if (method == "inverted" && queryType.find("topk") != string::npos) {
+        int K = stoi(queryType.substr(5));
+        vector<TopkIdQuery> queryObjs(queryVecs.size(), TopkIdQuery(K));
+        inverted_evaluate(queryObjs, queryVecs, baseFileName, numThreads);
+        QueryWriter writer;
+        writer.writeLSHBOX(lshboxBenchFileName, queryObjs);
+    } else if (method == "inverted" && queryType.find("radius") != string::npos) {
+        float radius = stof(queryType.substr(7));
+        vector<RadiusQuery<FeatureType>> queryObjs;
+        for (const auto& query : queryVecs) {
+            queryObjs.push_back(RadiusQuery<FeatureType>(query, radius, sparseCalAngularDist));
+        }
+        inverted_evaluate(queryObjs, queryVecs, baseFileName, numThreads);
+        QueryWriter writer;
+        writer.writeLSHBOX(lshboxBenchFileName, queryObjs);
+    } else if (queryType.find("topk") != string::npos) {
         int K = stoi(queryType.substr(5));
         vector<GTQuery<FeatureType>> queryObjs = topk_evaluate(queryVecs, baseFileName, K, metric, numThreads);
         lshbox::GroundWriter writer;
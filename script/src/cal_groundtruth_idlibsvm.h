@@ -3,7 +3,9 @@
 #include <algorithm>
 #include <utility>
 #include <functional>
+#include <cmath>
 #include "gqr/util/cal_groundtruth.h"
+#include "lshcore/loader/idsvecs.hpp"
 using std::vector;
 using std::pair;
 using lshbox::GTQuery;
@@ -32,6 +34,22 @@ unsigned readIdLIBSVM(vector<vector<pair<int, float>>>& fvecs, ifstream& fin, un
     return readNumRecords;
 }
 
+// readIdLIBSVM for idsvecs files
+unsigned readIdSvecs(vector<vector<pair<int, float>>>& fvecs, IdSvecsReader& reader, unsigned maxNumRecords = UINT_MAX) {
+    unsigned readNumRecords = 0;
+    int itemId;
+    SparseVector<float> itemVector;
+
+    while(readNumRecords < maxNumRecords && reader.next(itemId, itemVector)) {
+        readNumRecords++;
+        fvecs.emplace_back(itemVector.toPairs());
+    }
+    return readNumRecords;
+}
+
+// acos(0), the distance of items sharing no feature with the query
+const float kOrthogonalDist = acos(0.0f);
+
 // wrapper
 float sparseCalAngularDist(
         const std::vector<std::pair<int, float>> & queryVector,
@@ -54,11 +72,19 @@ public:
     }
 
     void evaluate(const vector<FeatureType>& item, int itemId) override {
-        float distance = this->distor(this->content, item);
+        offer(itemId, this->distor(this->content, item));
+    }
+
+    void offer(int itemId, float distance) {
         if (distance <= radius)
             results.emplace_back(make_pair(itemId, distance));
     }
 
+    // items sharing no feature with the query are at acos(0)
+    bool needsOrthogonalItems() const {
+        return radius >= kOrthogonalDist;
+    }
+
     const std::vector<pair<int, float>>& getResults() const {
         return results;
     }
@@ -85,6 +111,138 @@ public:
 
 };
 
+// top-k by (distance, item id) for the inverted index search
+class TopkIdQuery {
+public:
+    explicit TopkIdQuery(int K) : K(K) {}
+
+    void offer(int itemId, float distance) {
+        pair<float, int> candidate(distance, itemId);
+        if (heap.size() < K) {
+            heap.push_back(candidate);
+            std::push_heap(heap.begin(), heap.end());
+        } else if (candidate < heap.front()) {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back() = candidate;
+            std::push_heap(heap.begin(), heap.end());
+        }
+    }
+
+    // items are offered in ascending id, so a later orthogonal item only
+    // enters if the current k-th is strictly further
+    bool needsOrthogonalItems() const {
+        return heap.size() < K || heap.front().first > kOrthogonalDist;
+    }
+
+    void sortResults() {
+        std::sort_heap(heap.begin(), heap.end());
+        results.clear();
+        for (const auto& c : heap) {
+            results.emplace_back(c.second, c.first);
+        }
+    }
+
+    const std::vector<pair<int, float>>& getResults() const {
+        return results;
+    }
+
+    int getK() const {
+        return K;
+    }
+
+private:
+    size_t K;
+    vector<pair<float, int>> heap;
+    vector<pair<int, float>> results;
+};
+
+/*
+ * Item features of one batch transposed: for every feature the items having
+ * it, with their values. The dot products of a query with the whole batch
+ * then only touch the posting lists of the query's features, which for
+ * tweet-like data with ~10 nnz in 500k dimensions is a tiny part of the batch.
+ * */
+class SparseInvertedIndex {
+public:
+    // item i of the batch gets id startIdx + i
+    void build(const vector<vector<pair<int, float>>>& items, int startIdx) {
+        _startIdx = startIdx;
+        int maxFeature = -1;
+        _norms.resize(items.size());
+        for (int i = 0; i < items.size(); ++i) {
+            _norms[i] = calL2Norm(items[i]);
+            for (const auto& f : items[i]) {
+                maxFeature = std::max(maxFeature, f.first);
+            }
+        }
+
+        // counting sort by feature
+        _offsets.assign(maxFeature + 2, 0);
+        for (const auto& item : items) {
+            for (const auto& f : item) {
+                ++_offsets[f.first + 1];
+            }
+        }
+        for (int f = 0; f <= maxFeature; ++f) {
+            _offsets[f + 1] += _offsets[f];
+        }
+        _items.resize(_offsets.back());
+        _values.resize(_offsets.back());
+        vector<size_t> next(_offsets.begin(), _offsets.end() - 1);
+        for (int i = 0; i < items.size(); ++i) {
+            for (const auto& f : items[i]) {
+                size_t pos = next[f.first]++;
+                _items[pos] = i;
+                _values[pos] = f.second;
+            }
+        }
+    }
+
+    int size() const {
+        return _norms.size();
+    }
+
+    int getId(int i) const {
+        return _startIdx + i;
+    }
+
+    float getNorm(int i) const {
+        return _norms[i];
+    }
+
+    /*
+     * Accumulates the dot products of query with the batch into dots, which
+     * must be zero on entry, and lists the items sharing a feature in touched.
+     * Query features are visited in the given order, so for a query sorted
+     * by index the sums equal the merge based dotProduct.
+     * */
+    void accumulate(
+        const vector<pair<int, float>>& query,
+        vector<float>& dots,
+        vector<char>& seen,
+        vector<int>& touched) const {
+
+        for (const auto& f : query) {
+            if (f.first < 0 || f.first + 1 >= _offsets.size()) continue;
+            for (size_t pos = _offsets[f.first]; pos < _offsets[f.first + 1]; ++pos) {
+                int i = _items[pos];
+                if (!seen[i]) {
+                    seen[i] = 1;
+                    touched.push_back(i);
+                }
+                dots[i] += f.second * _values[pos];
+            }
+        }
+    }
+
+private:
+    int _startIdx = 0;
+    vector<size_t> _offsets;
+    vector<int> _items;
+    vector<float> _values;
+    vector<float> _norms;
+};
+
 class QueryWriter{
 public:
     template<typename FeatureType>
@@ -110,6 +268,27 @@ public:
         lshboxFout.close();
         cout << "lshbox groundtruth are written into " << lshboxBenchFileName << endl;
     }
+
+    void writeLSHBOX(const char* lshboxBenchFileName, const vector<TopkIdQuery>& queryObjs) {
+        ofstream lshboxFout(lshboxBenchFileName);
+        if (!lshboxFout) {
+            cout << "cannot create output file " << lshboxBenchFileName << endl;
+            assert(false);
+        }
+        int K = queryObjs.empty() ? 0 : queryObjs[0].getK();
+        lshboxFout << queryObjs.size() << "\t" << K << endl;
+
+        for (int i = 0; i < queryObjs.size(); ++i) {
+            lshboxFout << i << "\t";
+            const vector<pair<int, float>>& pairs = queryObjs[i].getResults();
+            for (int idx = 0; idx < pairs.size(); ++idx) {
+                lshboxFout << pairs[idx].first << "\t" << pairs[idx].second << "\t";
+            }
+            lshboxFout << endl;
+        }
+        lshboxFout.close();
+        cout << "lshbox groundtruth are written into " << lshboxBenchFileName << endl;
+    }
 };
 }
 }
@@ -0,0 +1,81 @@
+#include "lshcore/attrfilter.hpp"
+#include "lshcore/querystore.hpp"
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+int main() {
+    // predicates
+    AttrPredicate any;
+    assert(any.accepts(ItemAttributes(3, 7, -5)));
+    AttrPredicate pred;
+    pred.tenant = 2;
+    pred.timeMin = 10;
+    pred.timeMax = 20;
+    assert(pred.accepts(ItemAttributes(2, 0, 10)));
+    assert(pred.accepts(ItemAttributes(2, 9, 20)));
+    assert(!pred.accepts(ItemAttributes(1, 0, 15)));
+    assert(!pred.accepts(ItemAttributes(2, 0, 21)));
+
+    // a summary never rejects a predicate one of its items matches
+    std::default_random_engine gen(0);
+    std::uniform_int_distribution<int> small(0, 100), time(0, 1000);
+    for (int trial = 0; trial < 1000; ++trial) {
+        AttrSummary summary;
+        vector<ItemAttributes> items;
+        for (int i = 0; i < 5; ++i) {
+            items.emplace_back(small(gen), small(gen), time(gen));
+            summary.add(items.back());
+        }
+        AttrPredicate p;
+        p.tenant = trial % 3 == 0 ? AttrPredicate::kAny : small(gen);
+        p.language = trial % 5 == 0 ? AttrPredicate::kAny : small(gen);
+        p.timeMin = time(gen);
+        p.timeMax = p.timeMin + time(gen) / 4;
+        bool matched = false;
+        for (const auto& a : items) matched = matched || p.accepts(a);
+        assert(!matched || summary.mayMatch(p));
+    }
+    AttrSummary summary;
+    summary.add(ItemAttributes(1, 2, 100));
+    summary.add(ItemAttributes(3, 2, 200));
+    AttrPredicate late;
+    late.timeMin = 201;
+    assert(!summary.mayMatch(late));
+    AttrPredicate tenant;
+    tenant.tenant = 2;
+    assert(!summary.mayMatch(tenant));
+
+    // attributes travel with the load messages
+    husky::BinStream stream;
+    stream << ItemAttributes(3, -1, 1LL << 40);
+    ItemAttributes received;
+    stream >> received;
+    assert(received.tenant == 3 && received.language == -1 && received.time == 1LL << 40);
+
+    // query messages
+    assert(queryIdOf(7) == 7);
+    assert(queryIdOf(BoundedQueryMsg<int>(7, 1.5)) == 7);
+
+    // per slot predicates, queries without one match everything
+    QueryStore<int, float> queries;
+    queries.add(5, vector<float>{1, 2});
+    queries.add(9, vector<float>{3, 4});
+    queries.finalize();
+    AttributeFilter<int> filter;
+    assert(!filter.enabled());
+    filter.setAttributePath("item_attributes.txt");
+    filter.setQueryPredicate(9, tenant);
+    filter.build(queries);
+    assert(filter.enabled());
+    int slot5 = queries.getSlot(5), slot9 = queries.getSlot(9);
+    assert(!filter.rejects(slot5, ItemAttributes(0, 0, 0)));
+    assert(!filter.rejects(slot9, ItemAttributes(2, 0, 15)));
+    assert(filter.rejects(slot9, ItemAttributes()));
+
+    cout << "attrfilter_test passed" << endl;
+    return 0;
+}
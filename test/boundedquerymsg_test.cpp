@@ -0,0 +1,82 @@
+#include "lshcore/boundedquerymsg.hpp"
+#include "lshcore/e2lshfactory.hpp"
+#include "lshcore/lshitem.hpp"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+typedef E2LSHFactory<int, float> Factory;
+typedef BoundedQueryMsg<int> Msg;
+
+// exposes the batch helper
+class BoundedItem : public LSHItem<int, float, Msg, pair<int, float>, Factory> {
+public:
+    explicit BoundedItem(const int& id) : LSHItem<int, float, Msg, pair<int, float>, Factory>(id) {}
+    size_t run(Factory& factory, const vector<Msg>& msgs) {
+        return calQueryDistsBounded(factory, msgs);
+    }
+    const vector<int>& ids() const { return batch_query_ids; }
+    const vector<float>& dists() const { return batch_dists; }
+};
+
+int main() {
+    // serialization
+    husky::BinStream stream;
+    stream << Msg(7, 2.5) << Msg();
+    Msg a, b;
+    stream >> a >> b;
+    assert(a.queryId == 7 && a.bound == 2.5f);
+    assert(b.bound == numeric_limits<float>::max());
+
+    const int dimension = 20;
+    mt19937 gen(3);
+    normal_distribution<float> normal;
+    Factory factory;
+    factory.initialize(2, 2, dimension, 4);
+    vector<vector<float>> queries(6, vector<float>(dimension));
+    for (int q = 0; q < queries.size(); ++q) {
+        for (auto& e : queries[q]) e = normal(gen);
+        factory.insertQueryVector(q, queries[q]);
+    }
+    factory.finishQueries();
+
+    vector<float> x(dimension);
+    for (auto& e : x) e = normal(gen);
+    BoundedItem item(100);
+    vector<float> copy = x;
+    item.setItemVector(copy);
+    Span<const float> xs(x.data(), x.size());
+    vector<float> exact(queries.size());
+    for (int q = 0; q < queries.size(); ++q) {
+        exact[q] = calE2Dist(Span<const float>(queries[q].data(), dimension), xs);
+    }
+
+    // unbounded queries and bounded ones the item beats are reported with
+    // their distances, once; the others are dropped
+    vector<Msg> msgs = {
+        Msg(0, numeric_limits<float>::max()),
+        Msg(1, exact[1] + 1),
+        Msg(2, exact[2] / 2),
+        Msg(0, numeric_limits<float>::max()),
+        Msg(3, numeric_limits<float>::max()),
+        Msg(4, exact[4] / 2),
+        Msg(5, exact[5] * 2)};
+    size_t n = item.run(factory, msgs);
+    assert(n == 4);
+    vector<bool> seen(queries.size(), false);
+    for (size_t i = 0; i < n; ++i) {
+        int q = item.ids()[i];
+        assert(!seen[q]);
+        seen[q] = true;
+        assert(fabs(item.dists()[i] - exact[q]) < 1e-4);
+    }
+    assert(seen[0] && seen[1] && !seen[2] && seen[3] && !seen[4] && seen[5]);
+
+    cout << "boundedquerymsg_test passed" << endl;
+    return 0;
+}
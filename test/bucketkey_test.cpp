@@ -0,0 +1,72 @@
+#include "lshcore/e2lshfactory.hpp"
+#include "lshcore/lshfactory/simhashfactory.hpp"
+#include "lshcore/lshfactory/apsimhashfactory.hpp"
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+// calBucketsInto must agree with the allocating calItemBuckets
+template<typename Factory, typename VectorType>
+void checkBuckets(const Factory& factory, const VectorType& v) {
+    vector<BucketKey> keys(factory.getNumTables());
+    factory.calBucketsInto(v, keys.data());
+
+    vector<vector<int>> buckets = factory.calItemBuckets(v);
+    assert(buckets.size() == keys.size());
+    for (int t = 0; t < buckets.size(); ++t) {
+        assert(buckets[t].back() == t);
+        BucketKey expected(buckets[t].data(), buckets[t].size() - 1, t);
+        assert(keys[t] == expected);
+    }
+}
+
+int main() {
+    std::default_random_engine gen(0);
+    std::normal_distribution<float> dist(0, 1);
+    int dimension = 32;
+
+    // exact packing of one and two ints
+    int two[2] = {-1, 7};
+    assert(BucketKey(two, 2, 0) != BucketKey(two + 1, 1, 0));
+    assert(BucketKey(two, 2, 0) != BucketKey(two, 2, 1));
+    assert(BucketKey(two, 2, 3).sig == ((uint64_t(0xffffffffu) << 32) | 7));
+
+    E2LSHFactory<int, float> e2short, e2long;
+    e2short.initialize(4, 2, dimension, 4);
+    e2long.initialize(3, 5, dimension, 4);
+    SimHashFactory<int, float> simhash;
+    simhash.initialize(3, 40, dimension);
+    APSimHashFactory<int, float> apsimhash;
+    apsimhash.initialize(6, 8, dimension);
+    APSparseSimHashFactory<int, float> apsparse;
+    apsparse.initialize(6, 8, dimension);
+
+    set<BucketKey> distinctKeys;
+    set<vector<int>> distinctSigs;
+    for (int round = 0; round < 100; ++round) {
+        vector<float> v(dimension);
+        for (auto& e : v) e = dist(gen);
+        checkBuckets(e2short, v);
+        checkBuckets(e2long, v);
+        checkBuckets(simhash, v);
+        checkBuckets(apsimhash, v);
+
+        vector<pair<int, float>> pairs;
+        for (int i = 0; i < dimension; i += 1 + round % 3) pairs.emplace_back(i, v[i]);
+        checkBuckets(apsparse, SparseVector<float>(pairs));
+
+        vector<BucketKey> keys(e2long.getNumTables());
+        e2long.calBucketsInto(v, keys.data());
+        distinctKeys.insert(keys[0]);
+        distinctSigs.insert(e2long.calItemBuckets(v)[0]);
+    }
+    // hashed signatures of 5 ints should not collide
+    assert(distinctKeys.size() == distinctSigs.size());
+
+    std::cout << "bucketkey_test passed" << std::endl;
+    return 0;
+}
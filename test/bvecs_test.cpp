@@ -0,0 +1,53 @@
+#include "lshcore/e2lshfactory.hpp"
+#include "lshcore/lshfactory/simhashfactory.hpp"
+#include "losha/common/distor.hpp"
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+int main() {
+    std::default_random_engine gen(0);
+    std::uniform_int_distribution<int> byte(0, 255);
+    int dimension = 128;
+
+    E2LSHFactory<int, uint8_t> e2u8;
+    E2LSHFactory<int, float> e2f;
+    e2u8.initialize(4, 3, dimension, 300);
+    e2f.initialize(4, 3, dimension, 300);
+    SimHashFactory<int, uint8_t> shu8;
+    SimHashFactory<int, float> shf;
+    shu8.initialize(4, 20, dimension);
+    shf.initialize(4, 20, dimension);
+
+    vector<uint8_t> prev(dimension);
+    for (int round = 0; round < 200; ++round) {
+        vector<uint8_t> v(dimension);
+        for (auto& e : v) e = byte(gen);
+        vector<float> vf(v.begin(), v.end()), prevf(prev.begin(), prev.end());
+
+        // integer kernels agree with the float ones on integral values
+        assert(e2u8.calDist(prev, v) == e2f.calDist(prevf, vf));
+        assert(shu8.calDist(prev, v) == shf.calDist(prevf, vf));
+        assert(calIntSquareE2Dist(prev, v) == static_cast<uint64_t>(calSquareE2Dist(prevf, vf)));
+
+        // widened projections give the same buckets
+        vector<BucketKey> ku8(e2u8.getNumTables()), kf(e2f.getNumTables());
+        e2u8.calBucketsInto(v, ku8.data());
+        e2f.calBucketsInto(vf, kf.data());
+        assert(ku8 == kf);
+        assert(shu8.calItemBuckets(v) == shf.calItemBuckets(vf));
+        prev = v;
+    }
+
+    // sums beyond one uint32 block stay exact
+    vector<uint8_t> zeros(3 * kUint8BlockSize, 0), full(3 * kUint8BlockSize, 255);
+    assert(calIntSquareE2Dist(zeros, full) == 3ULL * kUint8BlockSize * 255 * 255);
+    assert(dotProduct(Span<const uint8_t>(full), Span<const uint8_t>(full)) == 3.0f * kUint8BlockSize * 255 * 255);
+
+    std::cout << "bvecs_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "losha/common/distor.hpp"
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+int main() {
+    // the batched kernels equal calE2Dist for every query, with and without a remainder
+    std::default_random_engine gen(3);
+    std::uniform_real_distribution<float> valDist(-1, 1);
+    std::uniform_int_distribution<int> byteDist(0, 255);
+    const int dimension = 37;
+    for (int n : {1, 4, 7}) {
+        vector<vector<float>> queries(n, vector<float>(dimension));
+        vector<vector<uint8_t>> byteQueries(n, vector<uint8_t>(dimension));
+        vector<const float*> tile;
+        vector<const uint8_t*> byteTile;
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < dimension; ++j) {
+                queries[i][j] = valDist(gen);
+                byteQueries[i][j] = byteDist(gen);
+            }
+            tile.push_back(queries[i].data());
+            byteTile.push_back(byteQueries[i].data());
+        }
+        vector<float> item(dimension);
+        vector<uint8_t> byteItem(dimension);
+        for (int j = 0; j < dimension; ++j) {
+            item[j] = valDist(gen);
+            byteItem[j] = byteDist(gen);
+        }
+
+        vector<float> dists(n), byteDists(n);
+        calE2Dists(Span<const float>(item), tile.data(), n, dists.data());
+        calE2Dists(Span<const uint8_t>(byteItem), byteTile.data(), n, byteDists.data());
+        for (int i = 0; i < n; ++i) {
+            assert(dists[i] == calE2Dist(Span<const float>(queries[i]), Span<const float>(item)));
+            assert(byteDists[i] == calE2Dist(Span<const uint8_t>(byteQueries[i]), Span<const uint8_t>(byteItem)));
+        }
+    }
+
+    // bounded distances are exact up to the bound and abandoned past it
+    vector<float> q(100), v(100);
+    for (int j = 0; j < 100; ++j) {
+        q[j] = valDist(gen);
+        v[j] = valDist(gen);
+    }
+    Span<const float> qs(q), vs(v);
+    float exact = calE2Dist(qs, vs);
+    assert(calE2DistBounded(qs, vs, std::numeric_limits<float>::max()) == exact);
+    assert(calE2DistBounded(qs, vs, exact) == exact);
+    assert(calE2DistBounded(qs, vs, exact * 2) == exact);
+    assert(calE2DistBounded(qs, vs, exact / 2) > exact / 2);
+    vector<uint8_t> bq(100, 10), bv(100, 12);
+    assert(calE2DistBounded(Span<const uint8_t>(bq), Span<const uint8_t>(bv), 20) == 20);
+    assert(calE2DistBounded(Span<const uint8_t>(bq), Span<const uint8_t>(bv), 19) > 19);
+
+    std::cout << "distor_test passed" << std::endl;
+    return 0;
+}
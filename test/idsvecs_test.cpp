@@ -0,0 +1,61 @@
+#include "lshcore/loader/idsvecs.hpp"
+#include "lshcore/loader/loader.h"
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+int main() {
+    std::default_random_engine gen(0);
+    std::uniform_real_distribution<float> value(-1, 1);
+
+    // enough records to fill several blocks
+    vector<SparseVector<float>> vectors;
+    const char* fileName = "idsvecs_test.idsvecs";
+    assert(isIdSvecsPath(fileName));
+    {
+        IdSvecsWriter writer(fileName);
+        for (int i = 0; i < 3000; ++i) {
+            SparseVector<float> v;
+            for (int j = 0; j < 1 + i % 200; ++j) v.push_back(j * 7 + i % 3, value(gen));
+            assert(writer.write(i, v));
+            vectors.push_back(v);
+        }
+        // larger than a block
+        SparseVector<float> huge;
+        for (int j = 0; j < kIdSvecsBlockBytes / 8; ++j) huge.push_back(j, 1);
+        assert(!writer.write(-1, huge));
+    }
+
+    // block by block, as the chunk input format hands them to item_loader
+    ifstream fin(fileName, ios::binary);
+    vector<char> buffer(kIdSvecsBlockBytes);
+    int next = 0;
+    while (fin.read(buffer.data(), buffer.size())) {
+        boost::string_ref block(buffer.data(), buffer.size());
+        forEachRecord(block, parseIdSvecs,
+            [&next, &vectors](int& itemId, SparseVector<float>& v) {
+                assert(itemId == next);
+                assert(v == vectors[next]);
+                ++next;
+            });
+    }
+    assert(next == vectors.size());
+
+    ifstream fin2(fileName, ios::binary);
+    IdSvecsReader reader(fin2);
+    int itemId;
+    SparseVector<float> v;
+    for (int i = 0; i < vectors.size(); ++i) {
+        assert(reader.next(itemId, v));
+        assert(itemId == i && v == vectors[i]);
+    }
+    assert(!reader.next(itemId, v));
+    remove(fileName);
+
+    std::cout << "idsvecs_test passed" << std::endl;
+    return 0;
+}
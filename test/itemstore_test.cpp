@@ -0,0 +1,46 @@
+#include "lshcore/densevector.hpp"
+#include "lshcore/itemstore.hpp"
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+int main() {
+    std::default_random_engine gen(0);
+    std::uniform_real_distribution<float> dist(-1, 1);
+
+    // spans stay valid while the arena grows over several chunks
+    size_t perChunk = ArenaBuffer<float>::kChunkBytes / sizeof(float);
+    vector<vector<float>> owned;
+    vector<Span<const float>> spans;
+    for (int i = 0; i < 7; ++i) {
+        vector<float> v(perChunk / 3 + i);
+        for (auto& e : v) e = dist(gen);
+        spans.push_back(ItemStore<float>::local().append(v));
+        owned.push_back(v);
+    }
+    for (int i = 0; i < owned.size(); ++i) {
+        assert(spans[i].size() == owned[i].size());
+        assert(equal(owned[i].begin(), owned[i].end(), spans[i].begin()));
+    }
+
+    // sparse items keep indices and values in separate arenas
+    SparseVector<float> sparse(vector<pair<int, float>>{{1, 0.5}, {4, -1}, {9, 2}});
+    SparseSpan<float> sparseSpan = ItemStore<pair<int, float>>::local().append(sparse);
+    assert(toItemVector(sparseSpan) == sparse);
+
+    // items in the store and owned vectors convert into each other
+    int id = 3;
+    vector<float> v = owned[0];
+    DenseVector<int, float, true> stored(id, v);
+    assert(v.empty());
+    DenseVector<int, float> copy(stored);
+    assert(copy.getItemId() == 3);
+    assert(copy.getItemVector() == owned[0]);
+    assert(stored.getItemVector().data() != copy.getItemVector().data());
+
+    std::cout << "itemstore_test passed" << std::endl;
+    return 0;
+}
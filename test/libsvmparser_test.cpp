@@ -0,0 +1,55 @@
+#include "lshcore/loader/libsvmparser.hpp"
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+void checkLine(const string& text) {
+    boost::string_ref line(text);
+    int fastId = -1, refId = -1;
+    SparseVector<float> fast, ref;
+    parseIdLibsvm(line, fastId, fast);
+    parseIdLibsvmTokenized(line, refId, ref);
+    assert(fastId == refId);
+    // bitwise equal values, same indices
+    assert(fast == ref);
+}
+
+int main() {
+    std::default_random_engine gen(0);
+    std::uniform_real_distribution<float> value(-100, 100);
+    std::uniform_int_distribution<int> index(0, 500000);
+    std::uniform_int_distribution<int> format(0, 5);
+
+    checkLine("7 1:0.5 3:1e-3 9:-2.25");
+    checkLine("-12\t4:.5  2:5. 8:+3E2\t");
+    checkLine("3 1:0.1234567890123 2:1e30 3:-0 4:123456789 5:1e-20");
+    checkLine("4 5:0.5\r");
+    checkLine("2147483647 4294967295:1 0:0.00000001");
+
+    char buf[64];
+    for (int round = 0; round < 2000; ++round) {
+        string text = to_string(round);
+        int nnz = 1 + round % 50;
+        for (int i = 0; i < nnz; ++i) {
+            float v = value(gen);
+            switch (format(gen)) {
+                case 0: snprintf(buf, sizeof(buf), "%g", v); break;
+                case 1: snprintf(buf, sizeof(buf), "%.9g", v); break;
+                case 2: snprintf(buf, sizeof(buf), "%f", v); break;
+                case 3: snprintf(buf, sizeof(buf), "%e", v); break;
+                case 4: snprintf(buf, sizeof(buf), "%.3f", v / 1000); break;
+                default: snprintf(buf, sizeof(buf), "%d", static_cast<int>(v)); break;
+            }
+            text += (i % 7 == 0 ? "\t" : " ") + to_string(index(gen)) + ":" + buf;
+        }
+        checkLine(text);
+    }
+
+    std::cout << "libsvmparser_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,60 @@
+#include "lshcore/loader/loader.h"
+#include "lshcore/loader/mmapinputformat.hpp"
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+int main() {
+    const int dimension = 5, numItems = 10;
+    const int idRecordBytes = 8 + dimension * sizeof(float);
+
+    // the same vectors as idfvecs with ids 100.. and as fvecs
+    ofstream idfvecs("mmap_test.idfvecs", ios::binary), fvecs("mmap_test.fvecs", ios::binary);
+    for (int i = 0; i < numItems; ++i) {
+        int id = 100 + i;
+        vector<float> v(dimension);
+        for (int j = 0; j < dimension; ++j) v[j] = i * 10 + j;
+        idfvecs.write((char*)&id, 4);
+        idfvecs.write((char*)&dimension, 4);
+        idfvecs.write((char*)v.data(), dimension * 4);
+        fvecs.write((char*)&dimension, 4);
+        fvecs.write((char*)v.data(), dimension * 4);
+    }
+    idfvecs.close();
+    fvecs.close();
+
+    assert(MmapInputFormat::isLocalPath("file:///data/base.idfvecs"));
+    assert(!MmapInputFormat::isLocalPath("hdfs:///data/base.idfvecs"));
+
+    for (const char* path : {"file://mmap_test.idfvecs", "file://mmap_test.fvecs"}) {
+        bool withId = string(path).find("idfvecs") != string::npos;
+        // three workers cover all records exactly once, in order
+        vector<int> seen;
+        for (int part = 0; part < 3; ++part) {
+            MmapInputFormat infmt(idRecordBytes);
+            infmt.set_input(path, part, 3);
+            assert(infmt.is_setup());
+            boost::string_ref record;
+            while (infmt.next(record)) {
+                assert(record.size() == idRecordBytes);
+                int itemId;
+                vector<float> v;
+                parseIdFvecs(record, itemId, v);
+                int i = withId ? itemId - 100 : itemId;
+                assert(v.size() == dimension && v[1] == i * 10 + 1);
+                seen.push_back(i);
+            }
+        }
+        assert(seen.size() == numItems);
+        for (int i = 0; i < numItems; ++i) assert(seen[i] == i);
+    }
+    remove("mmap_test.idfvecs");
+    remove("mmap_test.fvecs");
+
+    std::cout << "mmapinputformat_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,57 @@
+#include "lshcore/pqcodes.hpp"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+int main() {
+    // with no more samples than centroids every sample is a centroid, so its
+    // code is exact and its asymmetric distance to itself is 0
+    const int dimension = 12;
+    std::default_random_engine gen(5);
+    std::uniform_real_distribution<float> valDist(-1, 1);
+    vector<float> samples(100 * dimension);
+    for (auto& e : samples) e = valDist(gen);
+    ProductQuantizer pq;
+    pq.train(samples, dimension, 4);
+    assert(pq.enabled() && pq.getNumSubspaces() == 4);
+
+    vector<uint8_t> code(4);
+    vector<float> table(4 * ProductQuantizer::kCentroids);
+    for (int i = 0; i < 100; ++i) {
+        Span<const float> v(&samples[i * dimension], dimension);
+        pq.encode(v, code.data());
+        pq.buildTable(v, table.data());
+        assert(pq.adcDist(table.data(), code.data()) == 0);
+    }
+
+    // the asymmetric distance is the squared distance to the reconstruction
+    Span<const float> q(&samples[0], dimension);
+    pq.buildTable(q, table.data());
+    pq.encode(Span<const float>(&samples[dimension], dimension), code.data());
+    float exact = 0;
+    for (int j = 0; j < dimension; ++j) {
+        float diff = samples[j] - samples[dimension + j];
+        exact += diff * diff;
+    }
+    assert(fabs(pq.adcDist(table.data(), code.data()) - exact) < 1e-4);
+
+    // the buffer keeps the topR smallest approximate distances per query
+    auto& buffer = RerankBuffer<int, Span<const float>>::local();
+    for (int i = 0; i < 10; ++i) {
+        buffer.offer(1, 3, 2, 10 - i, i, q);
+    }
+    int numDrained = 0;
+    buffer.drain([&](int slot, const vector<RerankBuffer<int, Span<const float>>::Candidate>& candidates) {
+        assert(slot == 1 && candidates.size() == 2);
+        for (const auto& c : candidates) assert(std::get<1>(c) >= 8);
+        ++numDrained;
+    });
+    assert(numDrained == 1);
+
+    std::cout << "pqcodes_test passed" << std::endl;
+    return 0;
+}
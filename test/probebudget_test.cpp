@@ -0,0 +1,48 @@
+#include "lshcore/probebudget.hpp"
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <utility>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+int main() {
+    ProbeBudget<int, int> budget;
+    vector<pair<BucketKey, int>> probed;
+    auto record = [&](const int& msg, const BucketKey& bId, int quota) {
+        assert(msg == 7);
+        probed.emplace_back(bId, quota);
+    };
+
+    // smallest bucket first, empty buckets skipped, the last one truncated
+    budget.request(1, 7, 10);
+    vector<pair<BucketKey, int>> sizes = {
+        {BucketKey(5, 0), 8}, {BucketKey(6, 1), 3}, {BucketKey(7, 2), 0}, {BucketKey(8, 3), 4}};
+    budget.allot(1, sizes, record);
+    assert(probed.size() == 3);
+    assert(probed[0] == make_pair(BucketKey(6, 1), 3));
+    assert(probed[1] == make_pair(BucketKey(8, 3), 4));
+    assert(probed[2] == make_pair(BucketKey(5, 0), 3));
+
+    // the budget holds over iterations
+    probed.clear();
+    budget.request(1, 7, 10);
+    budget.allot(1, sizes, record);
+    assert(probed.empty());
+
+    // queries that asked nothing get nothing
+    budget.allot(2, sizes, record);
+    assert(probed.empty());
+
+    // strided subsets are distinct and deterministic
+    set<size_t> picked;
+    ProbeBudget<int, int>::sample(100, 7, [&](size_t i) { assert(i < 100); picked.insert(i); });
+    assert(picked.size() == 7 && *picked.begin() == 0);
+    size_t n = 0;
+    ProbeBudget<int, int>::sample(5, 7, [&](size_t i) { assert(i == n++); });
+    assert(n == 5);
+
+    cout << "probebudget_test passed" << endl;
+    return 0;
+}
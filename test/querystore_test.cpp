@@ -0,0 +1,42 @@
+#include "lshcore/querystore.hpp"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+int main() {
+    // small integer ids index a flat array, slots follow insertion order
+    QueryStore<int, float> dense;
+    dense.add(7, vector<float>{3, 4});
+    dense.add(2, vector<float>{1, 0});
+    dense.add(0, vector<float>{0, -2});
+    dense.finalize();
+    assert(dense.size() == 3);
+    assert(dense.getSlot(7) == 0 && dense.getSlot(2) == 1 && dense.getSlot(0) == 2);
+    assert(dense.getId(1) == 2);
+    assert(dense.getVector(dense.getSlot(0))[1] == -2);
+    assert(dense.getNorm(0) == 5 && dense.getNorm(2) == 2);
+    // queries are contiguous
+    assert(dense.getVector(1).data() == dense.getVector(0).data() + 2);
+
+    // sparse and large ids fall back to hashing
+    QueryStore<int, pair<int, float>> sparse;
+    sparse.add(1 << 30, SparseVector<float>(vector<pair<int, float>>{{1, 3}, {5, 4}}));
+    sparse.add(-5, SparseVector<float>(vector<pair<int, float>>{{2, 1}}));
+    sparse.finalize();
+    assert(sparse.getSlot(-5) == 1);
+    assert(sparse.getVector(sparse.getSlot(1 << 30)).size() == 2);
+    assert(sparse.getVector(1).indices()[0] == 2);
+    assert(fabs(sparse.getNorm(0) - 5) < 1e-6);
+
+    QueryStore<string, float> named;
+    named.add("q", vector<float>{1});
+    named.finalize();
+    assert(named.getSlot("q") == 0);
+
+    std::cout << "querystore_test passed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "lshcore/radiusfilter.hpp"
+#include "lshcore/querystore.hpp"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+int main() {
+    // the bound grows with the radius and covers the whole sketch at pi
+    assert(RadiusFilter<int>::maxHamming(0, 3) == 0);
+    assert(RadiusFilter<int>::maxHamming(0.5, 3) < RadiusFilter<int>::maxHamming(0.9, 3));
+    assert(RadiusFilter<int>::maxHamming(0.9, 2) < RadiusFilter<int>::maxHamming(0.9, 3));
+    assert(RadiusFilter<int>::maxHamming(M_PI, 3) == SimHashSketcher::kBits);
+
+    // sketches of identical vectors agree, opposite ones differ in every bit
+    const int dimension = 32;
+    SimHashSketcher sketcher;
+    sketcher.initialize(dimension, 1);
+    mt19937 gen(7);
+    normal_distribution<float> normal;
+    vector<float> x(dimension), y(dimension);
+    for (auto& e : x) e = normal(gen);
+    for (int i = 0; i < dimension; ++i) y[i] = -x[i];
+    Span<const float> xs(x.data(), x.size()), ys(y.data(), y.size());
+    assert(SimHashSketcher::hamming(sketcher.sketch(xs), sketcher.sketch(xs)) == 0);
+    assert(SimHashSketcher::hamming(sketcher.sketch(xs), sketcher.sketch(ys)) == SimHashSketcher::kBits);
+
+    // sparse sketches only depend on the non-zeros
+    SparseVector<float> a(vector<pair<int, float>>{{3, 1}, {1000000, 2}});
+    SparseVector<float> b(vector<pair<int, float>>{{3, 2}, {1000000, 4}});
+    assert(sketcher.sketch(SparseSpan<float>(a)) == sketcher.sketch(SparseSpan<float>(b)));
+    // and need no projection matrix
+    SimHashSketcher sparseSketcher;
+    sparseSketcher.initialize(0, 1);
+    assert(sparseSketcher.sketch(SparseSpan<float>(a)) == sketcher.sketch(SparseSpan<float>(a)));
+
+    // per query radii override the global one, items far in angle are rejected
+    QueryStore<int, float> queries;
+    queries.add(10, x);
+    queries.add(11, y);
+    queries.finalize();
+    RadiusFilter<int> filter;
+    filter.initialize(0.5, true, dimension);
+    filter.setQueryRadius(11, 1.0);
+    filter.build(queries);
+    assert(filter.getRadius(0) == 0.5f && filter.getRadius(1) == 1.0f);
+    uint64_t itemSketch = filter.sketch(xs);
+    assert(!filter.rejects(0, itemSketch));
+    assert(filter.rejects(1, itemSketch));
+
+    std::cout << "radiusfilter_test passed" << std::endl;
+    return 0;
+}
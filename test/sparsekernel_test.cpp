@@ -0,0 +1,74 @@
+#include "losha/common/sparsekernel.hpp"
+#include "losha/common/distor.hpp"
+#include <cassert>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <utility>
+#include <vector>
+using namespace std;
+using namespace husky::losha;
+
+SparseVector<float> randomSparse(std::default_random_engine& gen, int dimension, int nnz) {
+    std::uniform_int_distribution<int> idxDist(0, dimension - 1);
+    std::uniform_real_distribution<float> valDist(-1, 1);
+    vector<pair<int, float>> pairs;
+    vector<bool> used(dimension, false);
+    while (pairs.size() < nnz) {
+        int idx = idxDist(gen);
+        if (used[idx]) continue;
+        used[idx] = true;
+        pairs.push_back(make_pair(idx, valDist(gen)));
+    }
+    return SparseVector<float>(pairs);
+}
+
+float referenceDot(const SparseVector<float>& a, const SparseVector<float>& b) {
+    float product = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+        for (size_t j = 0; j < b.size(); ++j)
+            if (a.index(i) == b.index(j)) product += a.value(i) * b.value(j);
+    return product;
+}
+
+int main() {
+    std::default_random_engine gen(0);
+    int dimension = 1000;
+    for (int round = 0; round < 200; ++round) {
+        SparseVector<float> shortVec = randomSparse(gen, dimension, 1 + round % 10);
+        SparseVector<float> longVec = randomSparse(gen, dimension, 1 + round % 10 + (round % 3) * 200);
+        float expected = referenceDot(shortVec, longVec);
+
+        float merge = sparseDotMerge(shortVec.indices(), shortVec.values(), shortVec.size(),
+            longVec.indices(), longVec.values(), longVec.size());
+        float gallop = sparseDotGallop(shortVec.indices(), shortVec.values(), shortVec.size(),
+            longVec.indices(), longVec.values(), longVec.size());
+        float dispatched = dotProduct(shortVec, longVec);
+        assert(fabs(merge - expected) < 1e-4);
+        assert(fabs(gallop - expected) < 1e-4);
+        assert(fabs(dispatched - expected) < 1e-4);
+
+        {
+            ScopedScatter<SparseVector<float>> scatter(longVec);
+            assert(fabs(dotProduct(shortVec, longVec) - expected) < 1e-4);
+            assert(fabs(dotProduct(longVec, shortVec) - expected) < 1e-4);
+        }
+        // the scratch must be clean again after the guard
+        assert(fabs(dotProduct(shortVec, longVec) - expected) < 1e-4);
+
+        vector<float> dense(dimension, 0);
+        for (size_t i = 0; i < longVec.size(); ++i) dense[longVec.index(i)] = longVec.value(i);
+        assert(fabs(dotProduct(dense, shortVec) - expected) < 1e-4);
+
+        float angular = calAngularDist(shortVec, longVec);
+        float aosAngular = calAngularDist(shortVec.toPairs(), longVec.toPairs());
+        assert(fabs(angular - aosAngular) < 1e-3);
+    }
+
+    // unsorted input is sorted on construction
+    vector<pair<int, float>> unsorted = {{5, 1.0}, {1, 2.0}, {3, 3.0}};
+    SparseVector<float> sorted(unsorted);
+    assert(sorted.index(0) == 1 && sorted.value(0) == 2.0);
+    assert(sorted.index(2) == 5 && sorted.value(2) == 1.0);
+    cout << "finished" << endl;
+}
@@ -5,18 +5,18 @@
 #include <string>
 #include <utility>
 
-#include "gqr/util/cal_groundtruth.h"
 #include "lshcore/lshutils.cpp"
 #include "losha/common/distor.hpp"
 
 #include "./cal_groundtruth_idfvecs.h"
+#include "./threadpool.h"
 using namespace std;
-using lshbox::GTQuery;
 using namespace husky::losha;
 
 int main(int argc, char** argv) {
     if (argc != 6 && argc != 7) {
-        cout << "usage: program base_file.idlibsvm query_file.idlibsvm K groundtruth_file.lshbox groundtruth_file.ivecs num_threads=4" << endl;
+        cout << "usage: program base_file.idfvecs query_file.idfvecs topk:K groundtruth_file.lshbox euclidean|angular|product num_threads=4" << endl;
+        cout << "product writes the negated inner products as distances, the largest first" << endl;
         return 0;
     }
 
@@ -29,6 +29,11 @@ int main(int argc, char** argv) {
     if (argc >= 7)
         numThreads = stoi(argv[6]);
 
+    BruteForceTopk::Metric metricType;
+    if (!BruteForceTopk::parseMetric(metric, metricType)) {
+        cout << "unsupported metric " << metric << ", use euclidean, angular or product" << endl;
+        return 0;
+    }
 
     ifstream queryFin(queryFileName);
     if (!queryFin) {
@@ -43,11 +48,13 @@ int main(int argc, char** argv) {
 
     if (queryType.find("topk") != string::npos) {
         int K = stoi(queryType.substr(5));
-        vector<TopkIdQuery<FeatureType>> queryObjs = topk_evaluate(queryVecs, baseFileName, K, metric, numThreads);
-        lshbox::GroundWriter writer;
-        TopkIdQuery<FeatureType>::writeLSHBOX(lshboxBenchFileName, queryObjs);
+        IdFvecsFile base(baseFileName);
+        ThreadPool pool(numThreads);
+        BruteForceTopk engine(queryVecs, K, metricType, pool);
+        engine.run(base);
+        engine.writeLSHBOX(lshboxBenchFileName);
     } else {
-        std::cout << "you must provide query type such as: topk:20 or radius:0.9" << std::endl;
+        std::cout << "you must provide query type such as: topk:20" << std::endl;
         assert(false);
     }
 
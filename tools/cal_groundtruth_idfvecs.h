@@ -1,13 +1,24 @@
 #pragma once
-#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
 #include <utility>
-#include <functional>
-#include "gqr/util/cal_groundtruth.h"
-#include "./cal_groundtruth_losha.h"
+#include <vector>
+
+#include "losha/common/distor.hpp"
+#include "./threadpool.h"
 using std::vector;
 using std::pair;
-using namespace lshbox;
 
 namespace husky {
 namespace losha {
@@ -28,133 +39,298 @@ unsigned readIdFVECS(vector<pair<int, vector<FeatureType>>>& fvecs, ifstream& fi
     return readNumRecords;
 }
 
-template<typename FeatureType>
-class TopkIdQuery : public GTQuery<FeatureType> {
+// read-only mapping of an idfvecs file: [int id][int dimension][float * dimension] per item
+class IdFvecsFile {
+public:
+    explicit IdFvecsFile(const char* fileName) {
+        int fd = open(fileName, O_RDONLY);
+        if (fd == -1) {
+            cout << "base File " << fileName << " does not exist" << endl;
+            assert(false);
+        }
+        struct stat st;
+        fstat(fd, &st);
+        _bytes = st.st_size;
+        if (_bytes != 0) {
+            void* p = mmap(nullptr, _bytes, PROT_READ, MAP_SHARED, fd, 0);
+            assert(p != MAP_FAILED);
+            _data = static_cast<const char*>(p);
+            memcpy(&_dimension, _data + sizeof(int), sizeof(int));
+            _recordBytes = 2 * sizeof(int) + _dimension * sizeof(float);
+            assert(_bytes % _recordBytes == 0);
+        }
+        close(fd);
+    }
+
+    ~IdFvecsFile() {
+        if (_data != nullptr) munmap(const_cast<char*>(_data), _bytes);
+    }
+
+    size_t size() const { return _data == nullptr ? 0 : _bytes / _recordBytes; }
+    int dimension() const { return _dimension; }
+
+    int id(size_t i) const {
+        int itemId;
+        memcpy(&itemId, _data + i * _recordBytes, sizeof(int));
+        return itemId;
+    }
+
+    const float* vector(size_t i) const {
+        return reinterpret_cast<const float*>(_data + i * _recordBytes + 2 * sizeof(int));
+    }
+
+    // start reading [begin, end) ahead while the previous block is computed
+    void willNeed(size_t begin, size_t end) const {
+        if (begin >= end) return;
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t from = begin * _recordBytes / page * page;
+        madvise(const_cast<char*>(_data) + from, end * _recordBytes - from, MADV_WILLNEED);
+    }
+
+private:
+    const char* _data = nullptr;
+    size_t _bytes = 0;
+    size_t _recordBytes = 0;
+    int _dimension = 0;
+};
+
+// dot products of x with four queries, eight partial sums per query so that
+// the compiler keeps them in vector registers
+inline void dot4(const float* x, const float* const* q, int d, float* out) {
+    float s0[8] = {0}, s1[8] = {0}, s2[8] = {0}, s3[8] = {0};
+    int i = 0;
+    for (; i + 8 <= d; i += 8) {
+        for (int l = 0; l < 8; ++l) {
+            float e = x[i + l];
+            s0[l] += e * q[0][i + l];
+            s1[l] += e * q[1][i + l];
+            s2[l] += e * q[2][i + l];
+            s3[l] += e * q[3][i + l];
+        }
+    }
+    float r[4] = {0, 0, 0, 0};
+    for (int l = 0; l < 8; ++l) {
+        r[0] += s0[l];
+        r[1] += s1[l];
+        r[2] += s2[l];
+        r[3] += s3[l];
+    }
+    for (; i < d; ++i) {
+        for (int j = 0; j < 4; ++j) r[j] += x[i] * q[j][i];
+    }
+    for (int j = 0; j < 4; ++j) out[j] = r[j];
+}
+
+inline float dot1(const float* x, const float* q, int d) {
+    float s[8] = {0};
+    int i = 0;
+    for (; i + 8 <= d; i += 8) {
+        for (int l = 0; l < 8; ++l) s[l] += x[i + l] * q[i + l];
+    }
+    float r = 0;
+    for (int l = 0; l < 8; ++l) r += s[l];
+    for (; i < d; ++i) r += x[i] * q[i];
+    return r;
+}
+
+/*
+ * Brute-force top-k over an mmap'ed idfvecs base. The base is scanned in
+ * superblocks that fit the last level cache. Within a superblock, each pool
+ * task owns a block of queries and its top-k heaps, and walks the items
+ * against its queries, so the query block stays in L1/L2 and no locks
+ * are needed. Distances come from dot products:
+ *     euclidean  ||q||^2 + ||x||^2 - 2 q.x
+ *     angular    -q.x / (||q|| ||x||)
+ *     product    -q.x (the largest inner products first)
+ * Scores only rank the candidates. The float expansion of the Euclidean one
+ * cancels when distances are close, so the heaps keep kSlack candidates
+ * beyond K and the final top-k are chosen among them by exact distances.
+ * The product metric writes the negated inner products as its distances.
+ * */
+class BruteForceTopk {
 public:
-    int queryId;
-    vector<pair<int, float>> results;
+    enum Metric { kEuclidean, kAngular, kProduct };
+
+    static const int kMaxQueryBlock = 32;
+    static const size_t kSlack = 16;
+    static const size_t kSuperBlockBytes = 8 << 20;
 
-    TopkIdQuery(
-        int qId, 
-        const vector<FeatureType>& cont,
+    static bool parseMetric(const string& name, Metric& metric) {
+        if (name == "euclidean") metric = kEuclidean;
+        else if (name == "angular") metric = kAngular;
+        else if (name == "product") metric = kProduct;
+        else return false;
+        return true;
+    }
+
+    BruteForceTopk(
+        const vector<pair<int, vector<float>>>& queries,
         int K,
-        std::function<float(const vector<FeatureType>&, const vector<FeatureType>&)> functor)
-        : GTQuery<FeatureType>(cont, K, functor){
-        queryId = qId; 
+        Metric metric,
+        ThreadPool& pool)
+        : _K(K), _capacity(K + kSlack), _metric(metric), _pool(pool) {
+        _numQueries = queries.size();
+        _dimension = queries.empty() ? 0 : queries[0].second.size();
+        _queries.resize(_numQueries * _dimension);
+        _queryIds.resize(_numQueries);
+        _queryNorms.resize(_numQueries);
+        for (int i = 0; i < _numQueries; ++i) {
+            assert(queries[i].second.size() == _dimension);
+            _queryIds[i] = queries[i].first;
+            std::copy(queries[i].second.begin(), queries[i].second.end(),
+                _queries.begin() + i * _dimension);
+            float squareNorm = dot1(queryVector(i), queryVector(i), _dimension);
+            _queryNorms[i] = metric == kAngular ? sqrt(squareNorm) : squareNorm;
+        }
+        _heaps.resize(_numQueries);
+
+        // enough query blocks to keep every thread busy
+        int perThread = (_numQueries + pool.size() - 1) / std::max(1, pool.size());
+        _queryBlock = std::max(4, std::min(kMaxQueryBlock, (perThread + 3) / 4 * 4));
+        _numQueryBlocks = (_numQueries + _queryBlock - 1) / _queryBlock;
     }
 
-    int getId() const {
-        return queryId;
+    void run(const IdFvecsFile& base) {
+        assert(base.size() == 0 || base.dimension() == _dimension);
+        size_t superBlock = std::max<size_t>(1024, kSuperBlockBytes / (_dimension * sizeof(float) + 8));
+        vector<float> itemNorms(superBlock);
+
+        base.willNeed(0, std::min(base.size(), superBlock));
+        for (size_t begin = 0; begin < base.size(); begin += superBlock) {
+            size_t end = std::min(base.size(), begin + superBlock);
+            base.willNeed(end, std::min(base.size(), end + superBlock));
+
+            // item norms once per superblock, shared by all query blocks
+            int numChunks = std::max(1, _pool.size());
+            _pool.parallelFor(numChunks, [&](int chunk) {
+                size_t n = end - begin;
+                for (size_t i = n * chunk / numChunks; i < n * (chunk + 1) / numChunks; ++i) {
+                    const float* x = base.vector(begin + i);
+                    float squareNorm = dot1(x, x, _dimension);
+                    itemNorms[i] = _metric == kAngular ? sqrt(squareNorm) : squareNorm;
+                }
+            });
+            _pool.parallelFor(_numQueryBlocks, [&](int block) {
+                scanBlock(block, base, begin, end, itemNorms.data());
+            });
+            cout << end << " items have been evaluated" << endl;
+        }
+        finish(base);
     }
 
-    static void writeLSHBOX(const char* lshboxBenchFileName, const vector<TopkIdQuery<FeatureType>>& queryObjs) {
-        // lshbox file
+    // same layout as the lshbox ground truth files, negated inner products for product
+    void writeLSHBOX(const char* lshboxBenchFileName) const {
         ofstream lshboxFout(lshboxBenchFileName);
         if (!lshboxFout) {
             cout << "cannot create output file " << lshboxBenchFileName << endl;
             assert(false);
         }
-        int K = queryObjs[0].getK();
-        lshboxFout << queryObjs.size() << "\t" << K << endl;
-        for (int i = 0; i < queryObjs.size(); ++i) {
-            assert(queryObjs[i].getK() == K);
-            lshboxFout << queryObjs[i].getId() << "\t";
-            auto topker = queryObjs[i].getTopK();
-            for (int idx = 0; idx < topker.size(); ++idx) {
-                lshboxFout << topker[idx].id << "\t" << topker[idx].distance << "\t";
+        lshboxFout << _numQueries << "\t" << _K << endl;
+        for (int i = 0; i < _numQueries; ++i) {
+            lshboxFout << _queryIds[i] << "\t";
+            for (const auto& r : _results[i]) {
+                lshboxFout << r.second << "\t" << r.first << "\t";
             }
             lshboxFout << endl;
         }
         lshboxFout.close();
         cout << "lshbox groundtruth are written into " << lshboxBenchFileName << endl;
     }
-};
 
-template<typename QueryType, typename FeatureType>
-void updateQueries(vector<QueryType*> queries, const vector<pair<int, vector<FeatureType>>>* itemsPtr) {
-    for (auto& query: queries) {
-        for (int i = 0; i < itemsPtr->size(); ++i) {
-            query->evaluate((*itemsPtr)[i].second,(*itemsPtr)[i].first);
-        }
+    // (distance, item id) ascending, valid after run()
+    const vector<pair<float, int>>& getResults(int query) const {
+        return _results[query];
     }
-}
 
-template<typename QueryType, typename FeatureType>
-void updateAll(vector<QueryType>& queries, const vector<pair<int, vector<FeatureType>>>& items, int numThreads = 4) {
-    vector<thread> threads;
-    int numQueriesPerThread = queries.size() / numThreads + 1;
-
-    int queryIdx = 0;
-    vector<QueryType*> queryLinks;
-    while(queryIdx < queries.size()) {
-        queryLinks.push_back(&queries[queryIdx++]);
-        if (queryLinks.size() == numQueriesPerThread) {
-            threads.push_back(thread(updateQueries<QueryType, FeatureType>, queryLinks, &items));
-            queryLinks.clear();
-        }
-    }
-    threads.push_back(thread(updateQueries<QueryType, FeatureType>, queryLinks, &items));
-    for (int i = 0; i < threads.size(); ++i) {
-        threads[i].join();
+private:
+    // (score, item index), max-heap on score
+    typedef pair<float, size_t> Candidate;
+
+    const float* queryVector(int i) const {
+        return _queries.data() + i * _dimension;
     }
-}
 
-template<typename QueryType, typename FeatureType>
-void evaluate(
-    std::vector<QueryType>& queryObjs,
-    const char* baseFileName,
-    int numThreads = 4,
-    int itemBatchSize = 200000) {
-
-    ifstream baseFin(baseFileName, ios::binary);
-    if (!baseFin) {
-        cout << "base File " << baseFileName << " does not exist" << endl;
-        assert(false);
-    }
-    int numItems = 0;
-    vector<pair<int, vector<FeatureType>>> items;
-    items.reserve(itemBatchSize);
-    while (true) {
-        readIdFVECS(items, baseFin, itemBatchSize);
-        if (items.size() == 0) {
-            break;
+    inline void offer(int query, float score, size_t index) {
+        auto& heap = _heaps[query];
+        if (heap.size() < _capacity) {
+            heap.emplace_back(score, index);
+            std::push_heap(heap.begin(), heap.end());
+        } else if (score < heap.front().first) {
+            std::pop_heap(heap.begin(), heap.end());
+            heap.back() = Candidate(score, index);
+            std::push_heap(heap.begin(), heap.end());
         }
-
-        updateAll(queryObjs, items, numThreads);
-        numItems += items.size();
-        cout << numItems << " items have been evaluated" << endl;
-        items.clear();
     }
 
-    baseFin.close();
-}
+    inline float score(int query, float dot, float itemNorm) const {
+        switch (_metric) {
+            case kEuclidean: return _queryNorms[query] + itemNorm - 2 * dot;
+            case kAngular: {
+                float norms = _queryNorms[query] * itemNorm;
+                return norms == 0 ? 0 : -dot / norms;
+            }
+            default: return -dot;
+        }
+    }
 
+    void scanBlock(int block, const IdFvecsFile& base, size_t begin, size_t end, const float* itemNorms) {
+        int qBegin = block * _queryBlock;
+        int qEnd = std::min(_numQueries, qBegin + _queryBlock);
+        float dots[4];
+        const float* q[4];
+        for (size_t i = begin; i < end; ++i) {
+            const float* x = base.vector(i);
+            float itemNorm = itemNorms[i - begin];
+            int qi = qBegin;
+            for (; qi + 4 <= qEnd; qi += 4) {
+                for (int j = 0; j < 4; ++j) q[j] = queryVector(qi + j);
+                dot4(x, q, _dimension, dots);
+                for (int j = 0; j < 4; ++j) {
+                    offer(qi + j, score(qi + j, dots[j], itemNorm), i);
+                }
+            }
+            for (; qi < qEnd; ++qi) {
+                offer(qi, score(qi, dot1(x, queryVector(qi), _dimension), itemNorm), i);
+            }
+        }
+    }
 
-template<typename FeatureType>
-vector<TopkIdQuery<FeatureType>> topk_evaluate(
-    const vector<pair<int, vector<FeatureType>>>& queryVecs,
-    const char* baseFileName,
-    int K,
-    string metric,
-    int numThreads = 4,
-    int itemBatchSize = 200000) {
-
-    vector<TopkIdQuery<FeatureType>> queryObjs;
-    for (int i = 0; i < queryVecs.size(); ++i) {
-        if (metric == "euclidean") {
-            queryObjs.push_back(TopkIdQuery<FeatureType>(queryVecs[i].first, queryVecs[i].second, K, calEuclideanDist));
-        } else if (metric == "angular") {
-            assert(false);
-        } else if (metric == "product") {
-            assert(false);
-        } else {
-            assert(false);
+    float exactDist(int query, const float* x) const {
+        Span<const float> q(queryVector(query), _dimension), v(x, _dimension);
+        switch (_metric) {
+            case kEuclidean: return calE2Dist(q, v);
+            case kAngular: return calAngularDist(q, v);
+            default: return -dot1(x, queryVector(query), _dimension);
         }
     }
-    evaluate<TopkIdQuery<FeatureType>, FeatureType>(queryObjs, baseFileName, numThreads);
-    return queryObjs;
-}
 
+    void finish(const IdFvecsFile& base) {
+        _results.assign(_numQueries, vector<pair<float, int>>());
+        _pool.parallelFor(_numQueries, [&](int query) {
+            auto& result = _results[query];
+            for (const auto& c : _heaps[query]) {
+                result.emplace_back(exactDist(query, base.vector(c.second)), base.id(c.second));
+            }
+            std::sort(result.begin(), result.end());
+            if (result.size() > _K) result.resize(_K);
+        });
+    }
+
+    size_t _K;
+    // candidates kept per query until the exact distances
+    size_t _capacity;
+    Metric _metric;
+    ThreadPool& _pool;
+    int _numQueries;
+    int _dimension;
+    int _queryBlock;
+    int _numQueryBlocks;
+    vector<float> _queries;
+    vector<int> _queryIds;
+    vector<float> _queryNorms;
+    vector<vector<Candidate>> _heaps;
+    vector<vector<pair<float, int>>> _results;
+};
 
 }
 }
@@ -1,50 +1,315 @@
-#include <iostream>
-#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
 #include <fstream>
-#include <utility>
+#include <iostream>
+#include <mutex>
+#include <sstream>
 #include <string>
-#include <cassert>
-#include "../../gqr/apps/opq_evaluate.cpp"
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "losha/common/triplet.hpp"
+#include "./threadpool.h"
 using namespace std;
+using namespace husky::losha;
+
+// shards are split into ranges of this size so that one big shard still uses all threads
+const size_t kRangeBytes = 64 << 20;
+const int kNumLocks = 4096;
+
+// lshbox ground truth: "numQueries\tK" then "queryId\t(itemId\tdistance\t)*" per query
+// queryIds[i] is the query id of row i
+bool readLshbox(const char* fileName, int& K, vector<int>& queryIds, vector<vector<pair<int, float>>>& groundTruth) {
+    ifstream fin(fileName);
+    if (!fin) return false;
+    int numQueries;
+    fin >> numQueries >> K;
+    string line;
+    getline(fin, line);
+    groundTruth.assign(numQueries, vector<pair<int, float>>());
+    queryIds.assign(numQueries, -1);
+    for (int i = 0; i < numQueries && getline(fin, line); ++i) {
+        const char* p = line.c_str();
+        char* end;
+        queryIds[i] = strtol(p, &end, 10);
+        p = end;
+        while (true) {
+            long itemId = strtol(p, &end, 10);
+            if (end == p) break;
+            p = end;
+            float distance = strtof(p, &end);
+            if (end == p) break;
+            p = end;
+            groundTruth[i].emplace_back(itemId, distance);
+        }
+    }
+    return true;
+}
+
+// the files of a result directory, or the file itself
+vector<string> listShards(const string& path) {
+    vector<string> shards;
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        shards.push_back(path);
+        return shards;
+    }
+    while (dirent* entry = readdir(dir)) {
+        string shard = path + "/" + entry->d_name;
+        struct stat st;
+        if (entry->d_name[0] != '.' && stat(shard.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            shards.push_back(shard);
+        }
+    }
+    closedir(dir);
+    sort(shards.begin(), shards.end());
+    return shards;
+}
+
+/*
+ * The best maxK results of every query. Results are streamed in, only a
+ * bounded max-heap per query is kept, guarded by striped locks as shards
+ * are read in parallel. An item reported twice for a query counts once.
+ * */
+class TopkResults {
+public:
+    // results are kept by ground truth row, queryIds[row] being the query id of row
+    TopkResults(const vector<int>& queryIds, int maxK) : _maxK(maxK), _heaps(queryIds.size()), _locks(kNumLocks) {
+        for (int row = 0; row < queryIds.size(); ++row) {
+            _rows[queryIds[row]] = row;
+        }
+    }
+
+    void offer(int queryId, int itemId, float distance) {
+        auto it = _rows.find(queryId);
+        if (it == _rows.end()) {
+            lock_guard<mutex> lock(_locks[0]);
+            ++_numInvalid;
+            return;
+        }
+        int row = it->second;
+        pair<float, int> candidate(distance, itemId);
+        lock_guard<mutex> lock(_locks[row % kNumLocks]);
+        auto& heap = _heaps[row];
+        if (heap.size() == _maxK && !(candidate < heap.front())) return;
+        for (const auto& c : heap) {
+            if (c.second == itemId) return;
+        }
+        if (heap.size() == _maxK) {
+            pop_heap(heap.begin(), heap.end());
+            heap.pop_back();
+        }
+        heap.push_back(candidate);
+        push_heap(heap.begin(), heap.end());
+    }
+
+    // ascending by distance, call once all results are in
+    vector<pair<float, int>>& sorted(int row) {
+        auto& heap = _heaps[row];
+        if (!is_sorted(heap.begin(), heap.end())) sort_heap(heap.begin(), heap.end());
+        return heap;
+    }
+
+    size_t numInvalid() const { return _numInvalid; }
+
+private:
+    size_t _maxK;
+    unordered_map<int, int> _rows;
+    vector<vector<pair<float, int>>> _heaps;
+    vector<mutex> _locks;
+    size_t _numInvalid = 0;
+};
+
+// a byte range of an mmap'ed shard
+struct ShardRange {
+    int shard;
+    size_t begin;
+    size_t end;
+};
+
+void readBinaryRange(const char* data, size_t begin, size_t end, TopkResults& results) {
+    int queryId, itemId;
+    float distance;
+    for (size_t p = begin; p + kTripletBytes <= end; p += kTripletBytes) {
+        decodeTriplet(data + p, queryId, itemId, distance);
+        results.offer(queryId, itemId, distance);
+    }
+}
+
+// lines "queryId itemId distance" or "queryId (itemId distance)*" starting in [begin, end)
+void readTextRange(const char* data, size_t size, size_t begin, size_t end, TopkResults& results) {
+    size_t p = begin;
+    if (p != 0) {
+        while (p < size && data[p - 1] != '\n') ++p;
+    }
+    string line;
+    while (p < end) {
+        const char* lineEnd = static_cast<const char*>(memchr(data + p, '\n', size - p));
+        size_t next = lineEnd == nullptr ? size : lineEnd - data + 1;
+        // strtol/strtof need a terminator
+        line.assign(data + p, next - p);
+        p = next;
+
+        const char* s = line.c_str();
+        char* e;
+        long queryId = strtol(s, &e, 10);
+        if (e == s) continue;
+        s = e;
+        while (true) {
+            long itemId = strtol(s, &e, 10);
+            if (e == s) break;
+            s = e;
+            float distance = strtof(s, &e);
+            if (e == s) break;
+            s = e;
+            results.offer(queryId, itemId, distance);
+        }
+    }
+}
+
 int main(int argc, char** argv) {
-    if (argc < 3) {
-        cout << "Usage: evalaute_triplets lshbox_file triplets_file" << endl;
+    if (argc < 3 || argc > 6) {
+        cout << "Usage: evalaute_triplets lshbox_file result_path [text|binary] [k1,k2,...] [num_threads=4]" << endl;
+        cout << "result_path is a result file or a directory of per-worker shards" << endl;
         return -1;
     }
 
     const char* lshbox_file = argv[1];
-    const char* triplets_file = argv[2];
+    string result_path = argv[2];
+    bool binary = argc >= 4 && string(argv[3]) == "binary";
+    int numThreads = argc >= 6 ? stoi(argv[5]) : 4;
 
-    Bencher lshboxBench(lshbox_file);
-    unsigned numQueries = lshboxBench.size();
-    vector<vector<pair<unsigned, float>>> results(numQueries, vector<pair<unsigned, float>>());
-
-    ifstream fin(triplets_file);
-
-    if (!fin) {
-        cout << "cannot open file " << triplets_file << endl;
+    int K;
+    vector<int> queryIds;
+    vector<vector<pair<int, float>>> groundTruth;
+    if (!readLshbox(lshbox_file, K, queryIds, groundTruth)) {
+        cout << "cannot open file " << lshbox_file << endl;
         return -1;
     }
+    int numQueries = groundTruth.size();
 
-    string line;
-    int queryId;
-    int itemId;
-    float distance;
-    while(getline(fin, line)) {
-        istringstream iss(line);
-        iss >> queryId >> itemId >> distance;
-        results[queryId].push_back(make_pair(itemId, distance));
+    vector<int> ks;
+    if (argc >= 5) {
+        istringstream iss(argv[4]);
+        string k;
+        while (getline(iss, k, ',')) ks.push_back(stoi(k));
+    } else {
+        ks = {1, 10, K};
+    }
+    for (auto& k : ks) k = max(1, min(k, K));
+    sort(ks.begin(), ks.end());
+    ks.erase(unique(ks.begin(), ks.end()), ks.end());
+
+    // stream all shards into the bounded heaps
+    vector<string> shards = listShards(result_path);
+    vector<const char*> data(shards.size(), nullptr);
+    vector<size_t> sizes(shards.size(), 0);
+    vector<ShardRange> ranges;
+    for (int i = 0; i < shards.size(); ++i) {
+        int fd = open(shards[i].c_str(), O_RDONLY);
+        if (fd == -1) {
+            cout << "cannot open file " << shards[i] << endl;
+            return -1;
+        }
+        struct stat st;
+        fstat(fd, &st);
+        sizes[i] = st.st_size;
+        if (sizes[i] != 0) {
+            void* p = mmap(nullptr, sizes[i], PROT_READ, MAP_PRIVATE, fd, 0);
+            assert(p != MAP_FAILED);
+            madvise(p, sizes[i], MADV_SEQUENTIAL);
+            data[i] = static_cast<const char*>(p);
+        }
+        close(fd);
+        size_t step = binary ? kRangeBytes / kTripletBytes * kTripletBytes : kRangeBytes;
+        for (size_t begin = 0; begin < sizes[i]; begin += step) {
+            ranges.push_back({i, begin, min(sizes[i], begin + step)});
+        }
     }
 
-    for (auto& vec : results) {
-        sort(vec.begin(), vec.end(),
-            [](const pair<unsigned, float>& a, const pair<unsigned, float>& b) {
-            return a.second < b.second;
-        });
+    ThreadPool pool(numThreads);
+    TopkResults results(queryIds, K);
+    pool.parallelFor(ranges.size(), [&](int r) {
+        const ShardRange& range = ranges[r];
+        if (binary) {
+            readBinaryRange(data[range.shard], range.begin, range.end, results);
+        } else {
+            readTextRange(data[range.shard], sizes[range.shard], range.begin, range.end, results);
+        }
+    });
+    for (int i = 0; i < shards.size(); ++i) {
+        if (data[i] != nullptr) munmap(const_cast<char*>(data[i]), sizes[i]);
     }
-    fin.close();
+    if (results.numInvalid() != 0) {
+        cout << results.numInvalid() << " results with unknown query ids are ignored" << endl;
+    }
+
+    /*
+     * recall@k: |result top-k and ground truth top-k| / k
+     * error@k: mean of result[i] / groundTruth[i] distance over the returned
+     * i < k, skipping exact matches at distance 0
+     * */
+    int numChunks = pool.size() * 4;
+    vector<vector<double>> recallSums(numChunks, vector<double>(ks.size(), 0));
+    vector<vector<double>> errorSums(numChunks, vector<double>(ks.size(), 0));
+    vector<vector<int>> errorCounts(numChunks, vector<int>(ks.size(), 0));
+    pool.parallelFor(numChunks, [&](int chunk) {
+        vector<int> gtIds, resultIds, common;
+        for (int q = numQueries * chunk / numChunks; q < numQueries * (chunk + 1) / numChunks; ++q) {
+            const auto& result = results.sorted(q);
+            const auto& truth = groundTruth[q];
+            for (int j = 0; j < ks.size(); ++j) {
+                int k = ks[j];
+                size_t numTruth = min<size_t>(k, truth.size());
+                size_t numResult = min<size_t>(k, result.size());
+                gtIds.clear();
+                resultIds.clear();
+                common.clear();
+                for (size_t i = 0; i < numTruth; ++i) gtIds.push_back(truth[i].first);
+                for (size_t i = 0; i < numResult; ++i) resultIds.push_back(result[i].second);
+                sort(gtIds.begin(), gtIds.end());
+                sort(resultIds.begin(), resultIds.end());
+                set_intersection(gtIds.begin(), gtIds.end(), resultIds.begin(), resultIds.end(), back_inserter(common));
+                recallSums[chunk][j] += static_cast<double>(common.size()) / k;
 
-    cout << "avg recall:" << cal_avg_recall(lshboxBench, results, true) << endl;
-    cout << "avg error: " << cal_avg_error(lshboxBench, results, true) << endl;
+                double error = 0;
+                int count = 0;
+                for (size_t i = 0; i < numResult && i < numTruth; ++i) {
+                    if (truth[i].second == 0) continue;
+                    error += result[i].first / truth[i].second;
+                    ++count;
+                }
+                if (count != 0) {
+                    errorSums[chunk][j] += error / count;
+                    ++errorCounts[chunk][j];
+                }
+            }
+        }
+    });
 
+    for (int j = 0; j < ks.size(); ++j) {
+        double recall = 0, error = 0;
+        int count = 0;
+        for (int chunk = 0; chunk < numChunks; ++chunk) {
+            recall += recallSums[chunk][j];
+            error += errorSums[chunk][j];
+            count += errorCounts[chunk][j];
+        }
+        recall = numQueries == 0 ? 0 : recall / numQueries;
+        error = count == 0 ? 0 : error / count;
+        if (ks[j] == K) {
+            cout << "avg recall:" << recall << endl;
+            cout << "avg error: " << error << endl;
+        }
+        cout << "recall@" << ks[j] << ": " << recall << "\terror@" << ks[j] << ": " << error << endl;
+    }
+    return 0;
 }
@@ -0,0 +1,47 @@
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#include "lshcore/loader/idsvecs.hpp"
+#include "lshcore/loader/libsvmparser.hpp"
+#include "lshcore/lshutils.cpp"
+
+using namespace std;
+using namespace husky::losha;
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        cout << "Usage: idlibsvm_to_idsvecs input.idlibsvm output.idsvecs" << endl;
+        return -1;
+    }
+
+    ifstream fin(argv[1]);
+    if (!fin) {
+        cout << "cannot open file " << argv[1] << endl;
+        return -1;
+    }
+    IdSvecsWriter writer(argv[2]);
+    if (!writer.good()) {
+        cout << "cannot open file " << argv[2] << endl;
+        return -1;
+    }
+
+    string text;
+    size_t numRecords = 0;
+    while (getline(fin, text)) {
+        if (text.empty()) continue;
+        boost::string_ref line(text);
+        int itemId;
+        SparseVector<float> itemVector;
+        parseIdLibsvm(line, itemId, itemVector);
+        if (!writer.write(itemId, itemVector)) {
+            cout << "item " << itemId << " with " << itemVector.size()
+                << " entries does not fit into one block" << endl;
+            return -1;
+        }
+        ++numRecords;
+    }
+    writer.close();
+    cout << numRecords << " items written to " << argv[2] << endl;
+    return 0;
+}
@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "lshcore/loader/libsvmparser.hpp"
+#include "lshcore/lshutils.cpp"
+
+using namespace std;
+using namespace husky::losha;
+
+typedef void (*Parser)(boost::string_ref&, int&, SparseVector<float>&);
+
+// seconds to parse all lines, nnz is summed so the work is not optimized away
+double timeParser(Parser parse, const vector<string>& lines, size_t& nnz) {
+    auto start = chrono::steady_clock::now();
+    nnz = 0;
+    for (const auto& l : lines) {
+        boost::string_ref line(l);
+        int itemId;
+        SparseVector<float> itemVector;
+        parse(line, itemId, itemVector);
+        nnz += itemVector.size();
+    }
+    chrono::duration<double> d = chrono::steady_clock::now() - start;
+    return d.count();
+}
+
+int main(int argc, char** argv) {
+    if (argc > 1 && string(argv[1]) == "-h") {
+        cout << "Usage: libsvm_loader_benchmark [idlibsvm_file]" << endl;
+        cout << "without a file, 100000 tweet-like lines are generated" << endl;
+        return 0;
+    }
+
+    vector<string> lines;
+    size_t bytes = 0;
+    if (argc > 1) {
+        ifstream fin(argv[1]);
+        if (!fin) {
+            cout << "cannot open file " << argv[1] << endl;
+            return -1;
+        }
+        string line;
+        while (getline(fin, line)) {
+            if (line.empty()) continue;
+            bytes += line.size();
+            lines.push_back(line);
+        }
+    } else {
+        std::default_random_engine gen(0);
+        std::uniform_int_distribution<int> index(0, 500000);
+        std::uniform_int_distribution<int> nnz(5, 30);
+        std::uniform_real_distribution<float> value(0, 1);
+        char buf[32];
+        for (int i = 0; i < 100000; ++i) {
+            string line = to_string(i);
+            for (int j = nnz(gen); j > 0; --j) {
+                snprintf(buf, sizeof(buf), "%.6f", value(gen));
+                line += " " + to_string(index(gen)) + ":" + buf;
+            }
+            bytes += line.size();
+            lines.push_back(line);
+        }
+    }
+
+    size_t refNnz, fastNnz;
+    double refTime = timeParser(parseIdLibsvmTokenized, lines, refNnz);
+    double fastTime = timeParser(parseIdLibsvm, lines, fastNnz);
+    if (refNnz != fastNnz) {
+        cout << "parsers disagree: " << refNnz << " vs " << fastNnz << " entries" << endl;
+        return -1;
+    }
+
+    double mb = bytes / 1e6;
+    cout << lines.size() << " lines, " << fastNnz << " entries, " << mb << " MB" << endl;
+    cout << "tokenizer: " << refTime << " s, " << mb / refTime << " MB/s" << endl;
+    cout << "scanner:   " << fastTime << " s, " << mb / fastTime << " MB/s" << endl;
+    return 0;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace husky {
+namespace losha {
+
+/*
+ * Fixed set of worker threads kept for the whole run, so that tools can
+ * hand out one parallelFor per data block without spawning threads each time.
+ * */
+class ThreadPool {
+public:
+    explicit ThreadPool(int numThreads) {
+        for (int t = 0; t < numThreads; ++t) {
+            _workers.emplace_back([this]() { work(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _stop = true;
+        }
+        _wake.notify_all();
+        for (auto& w : _workers) {
+            w.join();
+        }
+    }
+
+    int size() const { return _workers.size(); }
+
+    // runs task(i) for i in [0, n) on the pool and waits for all of them,
+    // on the calling thread if the pool has no threads
+    void parallelFor(int n, const std::function<void(int)>& task) {
+        if (n <= 0) return;
+        if (_workers.empty()) {
+            for (int i = 0; i < n; ++i) task(i);
+            return;
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _task = &task;
+        _next = 0;
+        _end = n;
+        _pending = n;
+        ++_round;
+        _wake.notify_all();
+        _done.wait(lock, [this]() { return _pending == 0; });
+        _task = nullptr;
+    }
+
+private:
+    void work() {
+        long long seenRound = 0;
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _wake.wait(lock, [&]() { return _stop || (_round != seenRound && _next < _end); });
+            if (_stop) return;
+            while (_next < _end) {
+                int i = _next++;
+                const std::function<void(int)>* task = _task;
+                lock.unlock();
+                (*task)(i);
+                lock.lock();
+                if (--_pending == 0) {
+                    _done.notify_all();
+                }
+            }
+            seenRound = _round;
+        }
+    }
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(int)>* _task = nullptr;
+    int _next = 0;
+    int _end = 0;
+    int _pending = 0;
+    long long _round = 0;
+    bool _stop = false;
+};
+
+} // namespace losha
+} // namespace husky
@@ -0,0 +1,210 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "./threadpool.h"
+
+using namespace std;
+using namespace husky::losha;
+
+/*
+ * fvecs/bvecs/ivecs -> idfvecs/idbvecs, same contract as script/idfvecs.py:
+ * every [int dimension][elements] record becomes [int id][int dimension][elements]
+ * with ids counting from the id offset in input order. fvecs and bvecs keep
+ * their elements, ivecs elements are cast to float. Optionally the first
+ * records are split off as queries and the next ones as training data, each
+ * output numbering its own records from the id offset.
+ * */
+
+const size_t kChunkRecords = 1 << 16;
+
+struct Output {
+    string fileName;
+    size_t begin;
+    size_t end;
+};
+
+bool hasSuffix(const string& s, const string& suffix) {
+    return s.size() >= suffix.size()
+        && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// "N:file"
+bool parseSplit(const string& arg, size_t& num, string& fileName) {
+    size_t colon = arg.find(':');
+    if (colon == string::npos || colon == 0 || colon + 1 == arg.size()) return false;
+    num = stoull(arg.substr(0, colon));
+    fileName = arg.substr(colon + 1);
+    return true;
+}
+
+bool convert(
+    const char* input, size_t inputRecordBytes, size_t elementBytes, bool castInt,
+    int dimension, const Output& output, int idOffset, ThreadPool& pool) {
+
+    size_t numRecords = output.end - output.begin;
+    size_t outputElementBytes = castInt ? sizeof(float) : elementBytes;
+    size_t outputRecordBytes = 2 * sizeof(int) + dimension * outputElementBytes;
+    size_t bytes = numRecords * outputRecordBytes;
+
+    int fd = open(output.fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1 || ftruncate(fd, bytes) != 0) {
+        cout << "cannot create output file " << output.fileName << endl;
+        if (fd != -1) close(fd);
+        return false;
+    }
+    if (bytes == 0) {
+        close(fd);
+        return true;
+    }
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        cout << "cannot mmap output file " << output.fileName << endl;
+        return false;
+    }
+    char* out = static_cast<char*>(p);
+
+    int numChunks = (numRecords + kChunkRecords - 1) / kChunkRecords;
+    pool.parallelFor(numChunks, [&](int chunk) {
+        size_t end = min(numRecords, (chunk + 1) * kChunkRecords);
+        for (size_t i = chunk * kChunkRecords; i < end; ++i) {
+            const char* src = input + (output.begin + i) * inputRecordBytes + sizeof(int);
+            char* dst = out + i * outputRecordBytes;
+            int itemId = idOffset + i;
+            memcpy(dst, &itemId, sizeof(int));
+            memcpy(dst + sizeof(int), &dimension, sizeof(int));
+            dst += 2 * sizeof(int);
+            if (castInt) {
+                for (int d = 0; d < dimension; ++d) {
+                    int value;
+                    memcpy(&value, src + d * sizeof(int), sizeof(int));
+                    float element = value;
+                    memcpy(dst + d * sizeof(float), &element, sizeof(float));
+                }
+            } else {
+                memcpy(dst, src, dimension * elementBytes);
+            }
+        }
+    });
+    munmap(p, bytes);
+    cout << numRecords << " items written to " << output.fileName << endl;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        cout << "Usage: vecs_to_idvecs input.{fvecs,bvecs,ivecs} base_output.{idfvecs,idbvecs}"
+            << " [--id-offset=0] [--threads=4] [--query=N:query_output] [--train=N:train_output]" << endl;
+        cout << "the first N records go to the query output, the next N to the train output" << endl;
+        return -1;
+    }
+
+    string inputFileName = argv[1];
+    Output base{argv[2], 0, 0};
+    int idOffset = 0;
+    int numThreads = 4;
+    Output query{"", 0, 0};
+    Output train{"", 0, 0};
+    size_t numQueries = 0;
+    size_t numTrain = 0;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        bool ok = true;
+        if (arg.compare(0, 12, "--id-offset=") == 0) {
+            idOffset = stoi(arg.substr(12));
+        } else if (arg.compare(0, 10, "--threads=") == 0) {
+            numThreads = max(1, stoi(arg.substr(10)));
+        } else if (arg.compare(0, 8, "--query=") == 0) {
+            ok = parseSplit(arg.substr(8), numQueries, query.fileName);
+        } else if (arg.compare(0, 8, "--train=") == 0) {
+            ok = parseSplit(arg.substr(8), numTrain, train.fileName);
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            cout << "unknown argument " << arg << endl;
+            return -1;
+        }
+    }
+
+    size_t elementBytes = sizeof(float);
+    bool castInt = false;
+    if (hasSuffix(inputFileName, ".bvecs")) {
+        elementBytes = sizeof(unsigned char);
+    } else if (hasSuffix(inputFileName, ".ivecs")) {
+        castInt = true;
+    } else if (!hasSuffix(inputFileName, ".fvecs")) {
+        cout << "input must be .fvecs, .bvecs or .ivecs" << endl;
+        return -1;
+    }
+
+    int fd = open(inputFileName.c_str(), O_RDONLY);
+    if (fd == -1) {
+        cout << "cannot open file " << inputFileName << endl;
+        return -1;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t bytes = st.st_size;
+    if (bytes < sizeof(int)) {
+        cout << inputFileName << " is empty" << endl;
+        close(fd);
+        return -1;
+    }
+    void* p = mmap(nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        cout << "cannot mmap file " << inputFileName << endl;
+        return -1;
+    }
+    madvise(p, bytes, MADV_SEQUENTIAL);
+    const char* input = static_cast<const char*>(p);
+
+    // all records have the dimension of the first one
+    int dimension;
+    memcpy(&dimension, input, sizeof(int));
+    size_t inputRecordBytes = sizeof(int) + dimension * elementBytes;
+    if (dimension <= 0 || bytes % inputRecordBytes != 0) {
+        cout << inputFileName << " is not a " << inputFileName.substr(inputFileName.rfind('.') + 1)
+            << " file of dimension " << dimension << endl;
+        return -1;
+    }
+    size_t numRecords = bytes / inputRecordBytes;
+    for (size_t i = 0; i < numRecords; ++i) {
+        int d;
+        memcpy(&d, input + i * inputRecordBytes, sizeof(int));
+        if (d != dimension) {
+            cout << "record " << i << " has dimension " << d << " instead of " << dimension << endl;
+            return -1;
+        }
+    }
+    if (numQueries + numTrain > numRecords) {
+        cout << "cannot split " << numQueries << " queries and " << numTrain
+            << " training records off " << numRecords << " records" << endl;
+        return -1;
+    }
+
+    query.end = numQueries;
+    train.begin = query.end;
+    train.end = train.begin + numTrain;
+    base.begin = train.end;
+    base.end = numRecords;
+
+    ThreadPool pool(numThreads);
+    for (const Output* output : {&query, &train, &base}) {
+        if (output->fileName.empty()) continue;
+        if (!convert(input, inputRecordBytes, elementBytes, castInt, dimension, *output, idOffset, pool)) {
+            return -1;
+        }
+    }
+    munmap(p, bytes);
+    return 0;
+}